@@ -69,7 +69,6 @@ class AStarExpansion : public Expander {
         AStarExpansion(PotentialCalculator* p_calc, int xs, int ys, unsigned char path_cost, unsigned char occ_dis_cost, const std::vector<XYPoint>& circle_center_point, double resolution);
         bool calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs,
                                  double start_x, double start_y, double end_x, double end_y, int cycles, float* potential);
-        int min_cost_index_;
     private:
         void add(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs, float* potential,
                 float prev_potential, int current_i, int next_i, int end_x, int end_y);
@@ -48,10 +48,10 @@
 #include <global_planner/expander.h>
 #include <gslib/gaussian_debug.h>
 
-// inserting onto the priority blocks
-#define push_cur(n)  { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ && currentEnd_<PRIORITYBUFSIZE){ currentBuffer_[currentEnd_++]=n; pending_[n]=true; }}
-#define push_next(n) { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ &&    nextEnd_<PRIORITYBUFSIZE){    nextBuffer_[   nextEnd_++]=n; pending_[n]=true; }}
-#define push_over(n) { if (n>=0 && n<ns_ && !pending_[n] && getCost(costs, n)<lethal_cost_ &&    overEnd_<PRIORITYBUFSIZE){    overBuffer_[   overEnd_++]=n; pending_[n]=true; }}
+// inserting onto the priority blocks, push_next and push_over are only given cells in the window
+#define push_cur(n)  { if (inWindow(n) && !pending_[n] && getCost(costs, n)<lethal_cost_ && currentEnd_<PRIORITYBUFSIZE){ currentBuffer_[currentEnd_++]=n; pending_[n]=true; }}
+#define push_next(n) { if (!pending_[n] && getCost(costs, n)<lethal_cost_ &&    nextEnd_<PRIORITYBUFSIZE){    nextBuffer_[   nextEnd_++]=n; pending_[n]=true; }}
+#define push_over(n) { if (!pending_[n] && getCost(costs, n)<lethal_cost_ &&    overEnd_<PRIORITYBUFSIZE){    overBuffer_[   overEnd_++]=n; pending_[n]=true; }}
 
 namespace global_planner {
 class DijkstraExpansion : public Expander {
@@ -84,17 +84,6 @@ class DijkstraExpansion : public Expander {
          */
         void updateCell(unsigned char* costs, float* potential, int n); /** updates the cell at index n */
 
-        float getCost(unsigned char* costs, int n) {
-            float c = costs[n];
-            if (c < lethal_cost_ - 1 || (unknown_ && c==255)) {
-                c = c * factor_ + neutral_cost_;
-                if (c >= lethal_cost_)
-                    c = lethal_cost_ - 1;
-                return c;
-            }
-            return lethal_cost_;
-        }
-
         /** block priority buffers */
         int *buffer1_, *buffer2_, *buffer3_; /**< storage buffers for priority blocks */
         int *currentBuffer_, *nextBuffer_, *overBuffer_; /**< priority buffer block ptrs */
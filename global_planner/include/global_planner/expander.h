@@ -41,6 +41,16 @@
 #include <global_planner/planner_core.h>
 #include <costmap_2d/costmap_2d.h>
 #include <gslib/gaussian_debug.h>
+#include <algorithm>
+#include <vector>
+#include <functional>
+
+// bits of Expander::windowNeighbors, for the 4-neighbors n - 1, n + 1, n - nx and n + nx
+#define WINDOW_LEFT 1
+#define WINDOW_RIGHT 2
+#define WINDOW_UP 4
+#define WINDOW_DOWN 8
+#define WINDOW_ALL 15
 
 namespace global_planner {
 
@@ -55,9 +65,10 @@ typedef struct _XYPoint {
 class Expander {
     public:
         Expander(PotentialCalculator* p_calc, int nx, int ny) :
-                unknown_(true), lethal_cost_(253), neutral_cost_(50), factor_(3.0), p_calc_(p_calc) {
+                min_cost_index_(0), unknown_(true), lethal_cost_(253), neutral_cost_(50), factor_(3.0), p_calc_(p_calc) {
             setSize(nx, ny);
         }
+        virtual ~Expander() {}
 //        virtual bool calculatePotentials(unsigned char* costs, double start_x, double start_y, double end_x, double end_y,
 //                                         int cycles, float* potential) = 0;
 
@@ -74,7 +85,28 @@ class Expander {
             nx_ = nx;
             ny_ = ny;
             ns_ = nx * ny;
+            setWindow(0, 0, nx - 1, ny - 1);
+            // a new potential array holds anything
+            touched_x0_ = 0;
+            touched_y0_ = 0;
+            touched_x1_ = nx - 1;
+            touched_y1_ = ny - 1;
         } /**< sets or resets the size of the map */
+
+        /**
+         * @brief  Restricts the expansion to a window of the map, out of it the potential stays POT_HIGH
+         * @param x0 The lowest x of the window, in cells
+         * @param y0 The lowest y of the window, in cells
+         * @param x1 The highest x of the window, in cells
+         * @param y1 The highest y of the window, in cells
+         */
+        void setWindow(int x0, int y0, int x1, int y1) {
+            window_x0_ = std::max(x0, 0);
+            window_y0_ = std::max(y0, 0);
+            window_x1_ = std::min(x1, nx_ - 1);
+            window_y1_ = std::min(y1, ny_ - 1);
+            whole_map_window_ = window_x0_ == 0 && window_y0_ == 0 && window_x1_ == nx_ - 1 && window_y1_ == ny_ - 1;
+        }
         void setLethalCost(unsigned char lethal_cost) {
             lethal_cost_ = lethal_cost;
         }
@@ -89,10 +121,12 @@ class Expander {
         }
 
         void clearEndpoint(unsigned char* costs, float* potential, int gx, int gy, int s){
-            int startCell = toIndex(gx, gy);
-            for(int i=-s;i<=s;i++){
-            for(int j=-s;j<=s;j++){
-                int n = startCell+i+nx_*j;
+            // the potential of a cell is computed from its 4-neighbors, so cells on the border of the map are left out
+            int x0 = std::max(gx - s, 1), x1 = std::min(gx + s, nx_ - 2);
+            int y0 = std::max(gy - s, 1), y1 = std::min(gy + s, ny_ - 2);
+            for(int x=x0;x<=x1;x++){
+            for(int y=y0;y<=y1;y++){
+                int n = toIndex(x, y);
                 if(potential[n]<POT_HIGH)
                     continue;
                 float c = costs[n]+neutral_cost_;
@@ -101,6 +135,28 @@ class Expander {
             }
             }
         }
+
+        /**
+         * @brief  Updates the potential of the last expansion, which covered the whole window, after some costs changed.
+         *         Only cells whose potential depends on the changed ones are computed again, and only as far as
+         *         needed for the target, the rest is left for the next repair
+         * @param costs The costs now
+         * @param changed Indexes of the cells whose cost changed since the last expansion or repair, may be empty
+         * @param target Index of the cell whose potential has to be final, -1 for all of them
+         * @param max_cells Number of cells to update at most
+         * @param potential The potential array of the last expansion
+         * @return False if it took more than max_cells, the potential has to be expanded again then
+         */
+        bool repairPotentials(unsigned char* costs, const std::vector<int>& changed, int target, int max_cells,
+                              float* potential);
+
+        /**
+         * @brief  Drops what was left to repair, for a potential expanded again
+         */
+        void clearRepair() {
+            repair_open_.clear();
+        }
+
         int min_cost_index_;
 
     protected:
@@ -108,10 +164,86 @@ class Expander {
             return x + nx_ * y;
         }
 
+        inline bool inWindow(int n) {
+            if (n < 0 || n >= ns_)
+                return false;
+            if (whole_map_window_)
+                return true;
+            int y = n / nx_, x = n - y * nx_;
+            return x >= window_x0_ && x <= window_x1_ && y >= window_y0_ && y <= window_y1_;
+        }
+
+        /**
+         * @brief  Which 4-neighbors of the cell at index n, which is in the window, are in it too, as WINDOW_* bits.
+         *         Only cells on the border of the window have neighbors out of it, so callers check the bits
+         *         instead of calling inWindow for every neighbor
+         */
+        inline int windowNeighbors(int n) {
+            // with the whole map, a cell off the first and last rows has every neighbor in the map
+            if (whole_map_window_ && n >= nx_ && n < ns_ - nx_)
+                return WINDOW_ALL;
+            int y = n / nx_, x = n - y * nx_;
+            return (x > window_x0_ ? WINDOW_LEFT : 0) | (x < window_x1_ ? WINDOW_RIGHT : 0) |
+                   (y > window_y0_ ? WINDOW_UP : 0) | (y < window_y1_ ? WINDOW_DOWN : 0);
+        }
+
+        float getCost(unsigned char* costs, int n) {
+            float c = costs[n];
+            if (c < lethal_cost_ - 1 || (unknown_ && c==255)) {
+                c = c * factor_ + neutral_cost_;
+                if (c >= lethal_cost_)
+                    c = lethal_cost_ - 1;
+                return c;
+            }
+            return lethal_cost_;
+        }
+
+        /**
+         * @brief  Potential the cell at index n would get from its neighbors now
+         */
+        float getRepairRhs(unsigned char* costs, float* potential, int n);
+
+        /**
+         * @brief  Puts the cell at index n to the cells to repair if its potential isn't the one it would get now
+         */
+        void updateRepair(unsigned char* costs, float* potential, int n);
+
+        void pushRepair(float potential, int n) {
+            repair_open_.push_back(RepairEntry(potential, n));
+            std::push_heap(repair_open_.begin(), repair_open_.end(), std::greater<RepairEntry>());
+        }
+
+        template<typename T>
+        void fillBox(T* array, int x0, int y0, int x1, int y1, T value) {
+            for (int y = y0; y <= y1; y++)
+                std::fill(array + toIndex(x0, y), array + toIndex(x1, y) + 1, value);
+        }
+
+        /**
+         * @brief  Sets the potential of the window and of the cells touched by the last expansion to POT_HIGH,
+         *         so that only the window has to be filled instead of the whole map
+         * @param potential The potential array, the same one every time until the size changes
+         */
+        void resetPotential(float* potential) {
+            fillBox(potential, touched_x0_, touched_y0_, touched_x1_, touched_y1_, (float)POT_HIGH);
+            // endpoints are set up to 2 cells around start and goal
+            touched_x0_ = std::max(window_x0_ - 2, 0);
+            touched_y0_ = std::max(window_y0_ - 2, 0);
+            touched_x1_ = std::min(window_x1_ + 2, nx_ - 1);
+            touched_y1_ = std::min(window_y1_ + 2, ny_ - 1);
+            fillBox(potential, touched_x0_, touched_y0_, touched_x1_, touched_y1_, (float)POT_HIGH);
+        }
+
         int nx_, ny_, ns_; /**< size of grid, in pixels */
+        int window_x0_, window_y0_, window_x1_, window_y1_; /**< cells which are expanded, inclusive */
+        bool whole_map_window_; /**< the window is the whole map, so only the map bounds are checked */
+        int touched_x0_, touched_y0_, touched_x1_, touched_y1_; /**< cells whose potential may not be POT_HIGH */
         bool unknown_;
         unsigned char lethal_cost_, neutral_cost_;
         int cells_visited_;
+        std::vector<int> seeds_; /**< cells whose potential was set by the last expansion instead of computed */
+        typedef std::pair<float, int> RepairEntry;
+        std::vector<RepairEntry> repair_open_; /**< heap of the cells left to repair, by the lower of potential and rhs */
         float factor_;
         PotentialCalculator* p_calc_;
 
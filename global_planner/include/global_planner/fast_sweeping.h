@@ -0,0 +1,79 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+/**
+ * @file fast_sweeping.h
+ * @brief expander which computes the same potential as DijkstraExpansion by
+ *        fast sweeping over tiles, the tiles of a wavefront run on a pool of threads
+ */
+
+#ifndef _FAST_SWEEPING_H
+#define _FAST_SWEEPING_H
+
+#include <vector>
+#include <boost/thread.hpp>
+
+#include <global_planner/planner_core.h>
+#include <global_planner/expander.h>
+#include <gslib/gaussian_debug.h>
+
+// tiles are SWEEPING_TILE_SIZE cells wide and high
+#define SWEEPING_TILE_SIZE 64
+// a cell whose potential drops by less than this doesn't keep its tile sweeping
+#define SWEEPING_TOLERANCE 1e-3
+
+namespace global_planner {
+class FastSweepingExpansion : public Expander {
+    public:
+        /**
+         * @param threads Number of threads sweeping tiles, the calling one included, 0 for one per core
+         */
+        FastSweepingExpansion(PotentialCalculator* p_calc, int nx, int ny, int threads);
+        ~FastSweepingExpansion();
+        bool calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs,
+                                 double start_x, double start_y, double end_x, double end_y, int cycles, float* potential);
+
+        void setPreciseStart(bool precise){ precise_ = precise; }
+    private:
+        /**
+         * @brief  Updates the cells of a tile in the order of the current sweep
+         * @param tile The index of the tile
+         * @return Number of cells updated
+         */
+        int sweepTile(int tile);
+
+        /**
+         * @brief  Sweeps the tiles of a wavefront, they don't share any edge so any thread may take any of them
+         * @param tiles Indexes of the tiles
+         */
+        void sweepWavefront(const std::vector<int>& tiles);
+
+        void runJobs(); /**< sweeps tiles of the current wavefront until none is left */
+        void work(); /**< loop of a worker thread */
+
+        bool precise_;
+
+        /** tiles of the window */
+        int tiles_x_, tiles_y_; /**< number of tiles along x and y */
+        std::vector<unsigned char> active_; /**< tiles to sweep in the current sweep */
+        std::vector<unsigned char> changed_; /**< tiles with cells updated in the current sweep */
+        std::vector<std::vector<int> > wavefronts_; /**< active tiles of each wavefront of the current sweep */
+
+        /** the current sweep */
+        unsigned char* costs_;
+        float* potential_;
+        int dir_x_, dir_y_; /**< direction of the sweep, 1 or -1 */
+
+        /** worker pool, the thread calling calculatePotentials sweeps tiles as well */
+        boost::thread_group workers_;
+        boost::mutex jobs_mutex_;
+        boost::condition_variable jobs_cond_; /**< signals a new wavefront or stopping_ */
+        boost::condition_variable done_cond_; /**< signals the last tile of a wavefront done */
+        const std::vector<int>* jobs_; /**< tiles of the current wavefront */
+        size_t next_job_;
+        int jobs_left_; /**< tiles of the current wavefront not done yet */
+        unsigned int generation_; /**< count of wavefronts handed to the workers */
+        bool stopping_;
+};
+} //end namespace global_planner
+#endif
@@ -114,6 +114,18 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         bool makePlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal, double tolerance,
                       std::vector<geometry_msgs::PoseStamped>& plan);
 
+        /**
+         * @brief Given a goal pose in the world, compute plans from several starts to it. The potential of the goal
+         *        is computed once, or repaired if it is kept from the last call, and each start is only traced back
+         * @param starts The start poses, the cells they are in are not cleared
+         * @param goal The goal pose
+         * @param costs Filled with the potential of each start, POT_HIGH if it can't reach the goal
+         * @param plans Filled with a plan from each start, empty if there's none, NULL for the costs alone
+         * @return Number of starts which can reach the goal
+         */
+        int makePlans(const std::vector<geometry_msgs::PoseStamped>& starts, const geometry_msgs::PoseStamped& goal,
+                      std::vector<double>& costs, std::vector<std::vector<geometry_msgs::PoseStamped> >* plans);
+
         /**
          * @brief  Computes the full navigation function for the map given a point in the world to start from
          * @param world_point The point to use for seeding the navigation function
@@ -190,9 +202,32 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         bool worldToMap(double wx, double wy, double& mx, double& my);
         void clearRobotCell(const tf::Stamped<tf::Pose>& global_pose, unsigned int mx, unsigned int my);
         void publishPotential(float* potential);
+        void setSize(int nx, int ny); /**< sets up the arrays and the planner for a map of this size */
+
+        /**
+         * @brief  Computes the potential of the whole map from the goal, or repairs the one kept for the same goal
+         *         where the costs changed since, as far as needed for the start cell
+         * @return True if the potential was computed
+         */
+        bool calculateGoalPotential(double goal_x, double goal_y, int start_i, unsigned char* path_costs);
+
+        /**
+         * @brief  Puts the cells whose costs differ from goal_potential_costs_ to changed_cells_ and takes their costs
+         * @return False if there are more than max_cells of them
+         */
+        bool findChangedCells(const unsigned char* costs, int ns, int max_cells);
+
+        /**
+         * @brief  Traces a plan from a start to the goal on the potential of the goal, which is left as it was
+         * @return True if a plan was found
+         */
+        bool getPlanFromGoalPotential(double start_x, double start_y, unsigned int start_x_i, unsigned int start_y_i,
+                                      double goal_x, double goal_y, const geometry_msgs::PoseStamped& goal,
+                                      std::vector<geometry_msgs::PoseStamped>& plan);
         bool ReadCircleCenterFromParams(ros::NodeHandle& nh, std::vector<XYPoint>* points);
 
         double planner_window_x_, planner_window_y_, default_tolerance_;
+        double window_margin_; /**< around start and goal of the first window planned in, in meters, 0 for the whole map */
         std::string tf_prefix_;
         boost::mutex mutex_;
         ros::ServiceServer make_plan_srv_;
@@ -209,6 +244,16 @@ class GlobalPlanner : public nav_core::BaseGlobalPlanner {
         void outlineMap(unsigned char* costarr, int nx, int ny, unsigned char value);
         unsigned char* cost_array_;
         float* potential_array_;
+        int nx_, ny_; /**< size of the potential array and of what the planner is set up for */
+
+        bool repairable_; /**< the expander computes potentials of the whole map which can be kept and repaired */
+        bool incremental_; /**< keep the potential of the last goal and repair it when costs change */
+        bool goal_potential_valid_; /**< potential_array_ holds the potential of the whole map from the goal below */
+        double goal_potential_x_, goal_potential_y_;
+        costmap_2d::Costmap2D* goal_potential_costmap_; /**< costmap the kept potential is of */
+        double goal_potential_origin_x_, goal_potential_origin_y_; /**< origin of that costmap then */
+        std::vector<unsigned char> goal_potential_costs_; /**< costs the kept potential is up to date with */
+        std::vector<int> changed_cells_; /**< cells whose costs changed since, buffer of findChangedCells */
         unsigned int start_x_, start_y_, end_x_, end_y_;
 
         bool old_navfn_behavior_;
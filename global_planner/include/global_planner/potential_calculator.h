@@ -44,6 +44,7 @@ class PotentialCalculator {
         PotentialCalculator(int nx, int ny) {
             setSize(nx, ny);
         }
+        virtual ~PotentialCalculator() {}
 
         virtual float calculatePotential(float* potential, unsigned char cost, int n, float prev_potential=-1){
             if(prev_potential < 0){
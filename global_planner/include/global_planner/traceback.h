@@ -45,11 +45,22 @@ namespace global_planner {
 class Traceback {
     public:
         Traceback(PotentialCalculator* p_calc) : p_calc_(p_calc) {}
+        virtual ~Traceback() {}
 
         virtual bool getPath(float* potential, double start_x, double start_y, double end_x, double end_y, std::vector<std::pair<float, float> >& path) = 0;
         virtual void setSize(int xs, int ys) {
             xs_ = xs;
             ys_ = ys;
+            setWindow(0, 0, xs - 1, ys - 1);
+        }
+        /**
+         * @brief  Sets the window of the map which the potential was calculated in, the path stays within it
+         */
+        void setWindow(int x0, int y0, int x1, int y1) {
+            window_x0_ = x0;
+            window_y0_ = y0;
+            window_x1_ = x1;
+            window_y1_ = y1;
         }
         inline int getIndex(int x, int y) {
             return x + y * xs_;
@@ -59,6 +70,7 @@ class Traceback {
         }
     protected:
         int xs_, ys_;
+        int window_x0_, window_y0_, window_x1_, window_y1_; /**< inclusive, in cells */
         unsigned char lethal_cost_;
         PotentialCalculator* p_calc_;
 };
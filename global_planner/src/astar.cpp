@@ -95,12 +95,13 @@ bool AStarExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros,
     int start_i = toIndex(start_x, start_y);
     queue_.push_back(Index(start_i, 0));
 
-    std::fill(potential, potential + ns_, POT_HIGH);
+    resetPotential(potential);
     potential[start_i] = 0;
 
     int goal_i = toIndex(end_x, end_y);
     int cycle = 0;
     min_cost_ = 0x7FFFFFFF;
+    min_cost_index_ = start_i;
 
     while (queue_.size() > 0 && cycle < cycles) {
         Index top = queue_[0];
@@ -111,10 +112,15 @@ bool AStarExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros,
         if (i == goal_i)
             return true;
 
-        add(costmap_ros, costs, path_costs, potential, potential[i], i, i + 1, end_x, end_y);
-        add(costmap_ros, costs, path_costs, potential, potential[i], i, i - 1, end_x, end_y);
-        add(costmap_ros, costs, path_costs, potential, potential[i], i, i + nx_, end_x, end_y);
-        add(costmap_ros, costs, path_costs, potential, potential[i], i, i - nx_, end_x, end_y);
+        int in_window = windowNeighbors(i);
+        if (in_window & WINDOW_RIGHT)
+            add(costmap_ros, costs, path_costs, potential, potential[i], i, i + 1, end_x, end_y);
+        if (in_window & WINDOW_LEFT)
+            add(costmap_ros, costs, path_costs, potential, potential[i], i, i - 1, end_x, end_y);
+        if (in_window & WINDOW_DOWN)
+            add(costmap_ros, costs, path_costs, potential, potential[i], i, i + nx_, end_x, end_y);
+        if (in_window & WINDOW_UP)
+            add(costmap_ros, costs, path_costs, potential, potential[i], i, i - nx_, end_x, end_y);
     }
 
     return false;
@@ -122,10 +128,6 @@ bool AStarExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros,
 
 void AStarExpansion::add(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs, float* potential,
                          float prev_potential, int current_i, int next_i, int end_x, int end_y) {
-    if (next_i < 0 || next_i >= nx_ * ny_) {
-      return;
-    }
-
     if (potential[next_i] < POT_HIGH) {
       return;
     }
@@ -76,6 +76,7 @@ void DijkstraExpansion::setSize(int xs, int ys) {
 //   or until it runs out of cells to update,
 //   or until the Start cell is found (atStart = true)
 // warnning: if we have no path.pgm , path_costs == NULL
+// with end_x < 0 it goes on until the whole window is done
 
 bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs,
                                             double start_x, double start_y, double end_x, double end_y, int cycles, float* potential) {
@@ -88,8 +89,9 @@ bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ro
     nextEnd_ = 0;
     overBuffer_ = buffer3_;
     overEnd_ = 0;
-    memset(pending_, 0, ns_ * sizeof(bool));
-    std::fill(potential, potential + ns_, POT_HIGH);
+    // pending_ is only set within the window, which the touched cells cover
+    fillBox(pending_, touched_x0_, touched_y0_, touched_x1_, touched_y1_, false);
+    resetPotential(potential);
 
     // set goal
     int k = toIndex(start_x, start_y);
@@ -103,6 +105,10 @@ bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ro
         potential[k+1] = neutral_cost_ * 2 * (1-dx)*dy;
         potential[k+nx_] = neutral_cost_*2*dx*(1-dy);
         potential[k+nx_+1] = neutral_cost_*2*(1-dx)*(1-dy);//*/
+        seeds_.assign(1, k);
+        seeds_.push_back(k+1);
+        seeds_.push_back(k+nx_);
+        seeds_.push_back(k+nx_+1);
 
         push_cur(k+2);
         push_cur(k-1);
@@ -115,6 +121,7 @@ bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ro
         push_cur(k+nx_*2+1);
     }else{
         potential[k] = 0;
+        seeds_.assign(1, k);
         push_cur(k+1);
         push_cur(k-1);
         push_cur(k-nx_);
@@ -126,13 +133,14 @@ bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ro
     int cycle = 0;        // which cycle we're on
 
     // set up start cell
-    int startCell = toIndex(end_x, end_y);
+    bool whole_window = end_x < 0;
+    int startCell = whole_window ? 0 : toIndex(end_x, end_y);
 
     for (; cycle < cycles; cycle++) // go for this many cycles, unless interrupted
             {
         // 
         if (currentEnd_ == 0 && nextEnd_ == 0) // priority blocks empty
-            return false;
+            return whole_window;
 
         // stats
         nc += currentEnd_;
@@ -169,7 +177,7 @@ bool DijkstraExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ro
         }
 
         // check if we've hit the Start cell
-        if (potential[startCell] < POT_HIGH)
+        if (!whole_window && potential[startCell] < POT_HIGH)
             break;
     }
     GAUSSIAN_INFO("CYCLES %d/%d ", cycle, cycles);
@@ -207,25 +215,26 @@ inline void DijkstraExpansion::updateCell(unsigned char* costs, float* potential
         float de = INVSQRT2 * (float)getCost(costs, n + nx_);
         potential[n] = pot;
         //GAUSSIAN_INFO("UPDATE %d %d %d %f", n, n%nx, n/nx, potential[n]);
+        int in_window = windowNeighbors(n);
         if (pot < threshold_)    // low-cost buffer block
                 {
-            if (potential[n - 1] > pot + le)
+            if ((in_window & WINDOW_LEFT) && potential[n - 1] > pot + le)
                 push_next(n-1);
-            if (potential[n + 1] > pot + re)
+            if ((in_window & WINDOW_RIGHT) && potential[n + 1] > pot + re)
                 push_next(n+1);
-            if (potential[n - nx_] > pot + ue)
+            if ((in_window & WINDOW_UP) && potential[n - nx_] > pot + ue)
                 push_next(n-nx_);
-            if (potential[n + nx_] > pot + de)
+            if ((in_window & WINDOW_DOWN) && potential[n + nx_] > pot + de)
                 push_next(n+nx_);
         } else            // overflow block
         {
-            if (potential[n - 1] > pot + le)
+            if ((in_window & WINDOW_LEFT) && potential[n - 1] > pot + le)
                 push_over(n-1);
-            if (potential[n + 1] > pot + re)
+            if ((in_window & WINDOW_RIGHT) && potential[n + 1] > pot + re)
                 push_over(n+1);
-            if (potential[n - nx_] > pot + ue)
+            if ((in_window & WINDOW_UP) && potential[n - nx_] > pot + ue)
                 push_over(n-nx_);
-            if (potential[n + nx_] > pot + de)
+            if ((in_window & WINDOW_DOWN) && potential[n + nx_] > pot + de)
                 push_over(n+nx_);
         }
     }
@@ -0,0 +1,92 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+#include <global_planner/planner_core.h>
+#include <global_planner/expander.h>
+#include <math.h>
+
+// a cell whose potential is within this of its rhs needs no repair
+#define REPAIR_TOLERANCE 1e-3
+
+namespace global_planner {
+
+//
+// repairs the potential after cost changes, the way D* Lite does on a graph
+// the potential a cell would get from its neighbors now, rhs, is compared
+//   to the one it has: a cell with a higher one than its rhs is lowered
+//   to it, a cell with a lower one lost what it came from and is raised
+//   to POT_HIGH first. Neighbors of a changed cell are checked again
+// cells are taken lowest potential first, and only until the one of the
+//   target is final, or all are with no target. What's left is kept for
+//   the next repair
+//
+
+bool Expander::repairPotentials(unsigned char* costs, const std::vector<int>& changed, int target, int max_cells,
+                                float* potential) {
+    for (size_t i = 0; i < changed.size(); i++)
+        updateRepair(costs, potential, changed[i]);
+
+    int neighbors[4] = { -1, 1, -nx_, nx_ };
+    int lowered = 0, raised = 0;
+    while (!repair_open_.empty()) {
+        if (target >= 0) {
+            float target_rhs = getRepairRhs(costs, potential, target);
+            if (repair_open_[0].first >= std::min(potential[target], target_rhs)
+                    && fabs(potential[target] - target_rhs) <= REPAIR_TOLERANCE)
+                break;
+        }
+
+        if (lowered + raised >= max_cells) {
+            GAUSSIAN_INFO("[Global Planner] gave up repairing the potential after %d cells", max_cells);
+            repair_open_.clear();
+            return false;
+        }
+
+        RepairEntry top = repair_open_[0];
+        std::pop_heap(repair_open_.begin(), repair_open_.end(), std::greater<RepairEntry>());
+        repair_open_.pop_back();
+        int n = top.second;
+        float rhs = getRepairRhs(costs, potential, n);
+        if (fabs(potential[n] - rhs) <= REPAIR_TOLERANCE)
+            continue;
+        float key = std::min(potential[n], rhs);
+        if (key > top.first + REPAIR_TOLERANCE) {
+            // it changed since it was pushed
+            pushRepair(key, n);
+            continue;
+        }
+
+        if (potential[n] > rhs) {
+            potential[n] = rhs;
+            lowered++;
+        } else {
+            potential[n] = POT_HIGH;
+            updateRepair(costs, potential, n);
+            raised++;
+        }
+        for (int j = 0; j < 4; j++)
+            updateRepair(costs, potential, n + neighbors[j]);
+    }
+    GAUSSIAN_INFO("[Global Planner] repaired the potential after %zu cost changes, %d cells lowered, %d raised, %zu left",
+                  changed.size(), lowered, raised, repair_open_.size());
+    return true;
+}
+
+float Expander::getRepairRhs(unsigned char* costs, float* potential, int n) {
+    if (std::find(seeds_.begin(), seeds_.end(), n) != seeds_.end())
+        return potential[n];
+    float c = getCost(costs, n);
+    if (c >= lethal_cost_)
+        return POT_HIGH;
+    return std::min(p_calc_->calculatePotential(potential, c, n), (float)POT_HIGH);
+}
+
+void Expander::updateRepair(unsigned char* costs, float* potential, int n) {
+    if (!inWindow(n))
+        return;
+    float rhs = getRepairRhs(costs, potential, n);
+    if (fabs(potential[n] - rhs) > REPAIR_TOLERANCE)
+        pushRepair(std::min(potential[n], rhs), n);
+}
+
+} //end namespace global_planner
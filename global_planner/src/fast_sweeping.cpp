@@ -0,0 +1,205 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+#include <global_planner/fast_sweeping.h>
+#include <boost/bind.hpp>
+#include <algorithm>
+
+namespace global_planner {
+
+FastSweepingExpansion::FastSweepingExpansion(PotentialCalculator* p_calc, int nx, int ny, int threads) :
+        Expander(p_calc, nx, ny), precise_(false), tiles_x_(0), tiles_y_(0), costs_(NULL), potential_(NULL),
+        dir_x_(1), dir_y_(1), jobs_(NULL), next_job_(0), jobs_left_(0), generation_(0), stopping_(false) {
+    if (threads <= 0)
+        threads = boost::thread::hardware_concurrency();
+    for (int i = 1; i < threads; i++)
+        workers_.create_thread(boost::bind(&FastSweepingExpansion::work, this));
+}
+
+FastSweepingExpansion::~FastSweepingExpansion() {
+    {
+        boost::mutex::scoped_lock lock(jobs_mutex_);
+        stopping_ = true;
+    }
+    jobs_cond_.notify_all();
+    workers_.join_all();
+}
+
+//
+// main propagation function
+// fast sweeping, each sweep goes over the window in one of the four
+//   diagonal directions, tile by tile along wavefronts, and updates
+//   every cell from the neighbors it has then
+// sweeps go on until no cell changes, only tiles in which or next to
+//   which something changed in the last sweep are swept again
+// the whole window is always done, with end_x < 0 too
+//
+
+bool FastSweepingExpansion::calculatePotentials(costmap_2d::Costmap2DROS* costmap_ros, unsigned char* costs, unsigned char* path_costs,
+                                                double start_x, double start_y, double end_x, double end_y, int cycles, float* potential) {
+    resetPotential(potential);
+
+    // set goal
+    int k = toIndex(start_x, start_y);
+
+    if(precise_)
+    {
+        double dx = start_x - (int)start_x, dy = start_y - (int)start_y;
+        dx = floorf(dx * 100 + 0.5) / 100;
+        dy = floorf(dy * 100 + 0.5) / 100;
+        potential[k] = neutral_cost_ * 2 * dx * dy;
+        potential[k+1] = neutral_cost_ * 2 * (1-dx)*dy;
+        potential[k+nx_] = neutral_cost_*2*dx*(1-dy);
+        potential[k+nx_+1] = neutral_cost_*2*(1-dx)*(1-dy);//*/
+        seeds_.assign(1, k);
+        seeds_.push_back(k+1);
+        seeds_.push_back(k+nx_);
+        seeds_.push_back(k+nx_+1);
+    }else{
+        potential[k] = 0;
+        seeds_.assign(1, k);
+    }
+
+    tiles_x_ = (window_x1_ - window_x0_) / SWEEPING_TILE_SIZE + 1;
+    tiles_y_ = (window_y1_ - window_y0_) / SWEEPING_TILE_SIZE + 1;
+    active_.assign(tiles_x_ * tiles_y_, 0);
+    changed_.assign(tiles_x_ * tiles_y_, 0);
+    wavefronts_.resize(tiles_x_ + tiles_y_ - 1);
+
+    // the cells set above may lie in the tiles next to the one of the start
+    int start_tx = std::min(std::max(((int)start_x - window_x0_) / SWEEPING_TILE_SIZE, 0), tiles_x_ - 1);
+    int start_ty = std::min(std::max(((int)start_y - window_y0_) / SWEEPING_TILE_SIZE, 0), tiles_y_ - 1);
+    for (int ty = std::max(start_ty - 1, 0); ty <= std::min(start_ty + 1, tiles_y_ - 1); ty++)
+        for (int tx = std::max(start_tx - 1, 0); tx <= std::min(start_tx + 1, tiles_x_ - 1); tx++)
+            active_[tx + ty * tiles_x_] = 1;
+
+    costs_ = costs;
+    potential_ = potential;
+    static const int directions[4][2] = { { 1, 1 }, { -1, 1 }, { -1, -1 }, { 1, -1 } };
+    int cycle = 0;
+    for (; cycle < cycles; cycle++) {
+        dir_x_ = directions[cycle % 4][0];
+        dir_y_ = directions[cycle % 4][1];
+
+        // a tile only needs the ones before it along both directions, which are on earlier wavefronts
+        for (size_t w = 0; w < wavefronts_.size(); w++)
+            wavefronts_[w].clear();
+        bool any_active = false;
+        for (int ty = 0; ty < tiles_y_; ty++) {
+            for (int tx = 0; tx < tiles_x_; tx++) {
+                int t = tx + ty * tiles_x_;
+                if (!active_[t])
+                    continue;
+                int w = (dir_x_ > 0 ? tx : tiles_x_ - 1 - tx) + (dir_y_ > 0 ? ty : tiles_y_ - 1 - ty);
+                wavefronts_[w].push_back(t);
+                any_active = true;
+            }
+        }
+        if (!any_active)
+            break;
+
+        std::fill(changed_.begin(), changed_.end(), 0);
+        for (size_t w = 0; w < wavefronts_.size(); w++) {
+            if (!wavefronts_[w].empty())
+                sweepWavefront(wavefronts_[w]);
+        }
+
+        for (int ty = 0; ty < tiles_y_; ty++) {
+            for (int tx = 0; tx < tiles_x_; tx++) {
+                int t = tx + ty * tiles_x_;
+                active_[t] = changed_[t] || (tx > 0 && changed_[t - 1]) || (tx < tiles_x_ - 1 && changed_[t + 1])
+                        || (ty > 0 && changed_[t - tiles_x_]) || (ty < tiles_y_ - 1 && changed_[t + tiles_x_]);
+            }
+        }
+    }
+    costs_ = NULL;
+    potential_ = NULL;
+    GAUSSIAN_INFO("SWEEPS %d/%d ", cycle, cycles);
+    if (cycle == cycles)
+        return false;
+
+    return end_x < 0 || potential[toIndex(end_x, end_y)] < POT_HIGH;
+}
+
+void FastSweepingExpansion::sweepWavefront(const std::vector<int>& tiles) {
+    if (workers_.size() == 0 || tiles.size() == 1) {
+        for (size_t i = 0; i < tiles.size(); i++)
+            changed_[tiles[i]] = sweepTile(tiles[i]) > 0;
+        return;
+    }
+
+    {
+        boost::mutex::scoped_lock lock(jobs_mutex_);
+        jobs_ = &tiles;
+        next_job_ = 0;
+        jobs_left_ = tiles.size();
+        generation_++;
+    }
+    jobs_cond_.notify_all();
+    runJobs();
+
+    boost::mutex::scoped_lock lock(jobs_mutex_);
+    while (jobs_left_ > 0)
+        done_cond_.wait(lock);
+    // late workers must not look at the wavefronts while they are rebuilt
+    jobs_ = NULL;
+}
+
+void FastSweepingExpansion::runJobs() {
+    boost::mutex::scoped_lock lock(jobs_mutex_);
+    while (jobs_ != NULL && next_job_ < jobs_->size()) {
+        int tile = (*jobs_)[next_job_++];
+        lock.unlock();
+        int updated = sweepTile(tile);
+        lock.lock();
+        changed_[tile] = updated > 0;
+        if (--jobs_left_ == 0)
+            done_cond_.notify_all();
+    }
+}
+
+void FastSweepingExpansion::work() {
+    unsigned int generation = 0;
+    while (true) {
+        {
+            boost::mutex::scoped_lock lock(jobs_mutex_);
+            while (!stopping_ && generation_ == generation)
+                jobs_cond_.wait(lock);
+            if (stopping_)
+                return;
+            generation = generation_;
+        }
+        runJobs();
+    }
+}
+
+int FastSweepingExpansion::sweepTile(int tile) {
+    int x0 = window_x0_ + (tile % tiles_x_) * SWEEPING_TILE_SIZE;
+    int y0 = window_y0_ + (tile / tiles_x_) * SWEEPING_TILE_SIZE;
+    int x1 = std::min(x0 + SWEEPING_TILE_SIZE - 1, window_x1_);
+    int y1 = std::min(y0 + SWEEPING_TILE_SIZE - 1, window_y1_);
+    if (dir_x_ < 0)
+        std::swap(x0, x1);
+    if (dir_y_ < 0)
+        std::swap(y0, y1);
+
+    int updated = 0;
+    for (int y = y0; y != y1 + dir_y_; y += dir_y_) {
+        for (int x = x0; x != x1 + dir_x_; x += dir_x_) {
+            int n = toIndex(x, y);
+            float c = getCost(costs_, n);
+            if (c >= lethal_cost_)    // don't propagate into obstacles
+                continue;
+
+            float pot = p_calc_->calculatePotential(potential_, c, n);
+            if (pot < potential_[n]) {
+                if (potential_[n] - pot > SWEEPING_TOLERANCE)
+                    updated++;
+                potential_[n] = pot;
+            }
+        }
+    }
+    return updated;
+}
+
+} //end namespace global_planner
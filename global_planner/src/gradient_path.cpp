@@ -73,8 +73,13 @@ bool GradientPath::getPath(float* potential, double start_x, double start_y, dou
     float dx = goal_x - (int)goal_x;
     float dy = goal_y - (int)goal_y;
     int ns = xs_ * ys_;
-    memset(gradx_, 0, ns * sizeof(float));
-    memset(grady_, 0, ns * sizeof(float));
+    // gradients are only calculated next to cells with a potential, which is within the window
+    // or at most 2 cells out of it around the endpoints
+    int x0 = std::max(window_x0_ - 2, 0), x1 = std::min(window_x1_ + 2, xs_ - 1);
+    for (int y = std::max(window_y0_ - 2, 0); y <= std::min(window_y1_ + 2, ys_ - 1); y++) {
+        memset(gradx_ + getIndex(x0, y), 0, (x1 - x0 + 1) * sizeof(float));
+        memset(grady_ + getIndex(x0, y), 0, (x1 - x0 + 1) * sizeof(float));
+    }
 
     int c = 0;
     while (c++<ns*4) {
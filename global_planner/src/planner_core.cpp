@@ -39,9 +39,12 @@
 #include <tf/transform_listener.h>
 #include <costmap_2d/cost_values.h>
 #include <costmap_2d/costmap_2d.h>
+#include <algorithm>
+#include <cstring>
 
 #include <global_planner/dijkstra.h>
 #include <global_planner/astar.h>
+#include <global_planner/fast_sweeping.h>
 #include <global_planner/grid_path.h>
 #include <global_planner/gradient_path.h>
 #include <global_planner/quadratic_calculator.h>
@@ -64,11 +67,15 @@ void GlobalPlanner::outlineMap(unsigned char* costarr, int nx, int ny, unsigned
 }
 
 GlobalPlanner::GlobalPlanner() :
-        costmap_(NULL), path_costmap_(NULL), initialized_(false), allow_unknown_(true) {
+        costmap_ros_(NULL), costmap_(NULL), path_costmap_(NULL), initialized_(false), allow_unknown_(true), potential_array_(NULL),
+        nx_(0), ny_(0), repairable_(false), incremental_(false), goal_potential_valid_(false),
+        goal_potential_costmap_(NULL), goal_potential_origin_x_(0.0), goal_potential_origin_y_(0.0) {
 }
 
 GlobalPlanner::GlobalPlanner(std::string name, costmap_2d::Costmap2D* costmap, std::string frame_id) :
-        costmap_(NULL), initialized_(false), allow_unknown_(true) {
+        costmap_ros_(NULL), costmap_(NULL), initialized_(false), allow_unknown_(true), potential_array_(NULL), nx_(0), ny_(0),
+        repairable_(false), incremental_(false), goal_potential_valid_(false),
+        goal_potential_costmap_(NULL), goal_potential_origin_x_(0.0), goal_potential_origin_y_(0.0) {
     //initialize the planner
     initialize(name, costmap, costmap, frame_id);
 }
@@ -80,6 +87,10 @@ GlobalPlanner::~GlobalPlanner() {
         delete planner_;
     if (path_maker_)
         delete path_maker_;
+    if (orientation_filter_)
+        delete orientation_filter_;
+    if (potential_array_)
+        delete[] potential_array_;
 }
 
 double GetNumberFromXMLRPC(XmlRpc::XmlRpcValue& value, const std::string& full_param_name) {
@@ -170,7 +181,17 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
 
         bool use_dijkstra;
         private_nh.param("p2", use_dijkstra, true);
-        if (use_dijkstra)
+        bool use_fast_sweeping;
+        private_nh.param("p9", use_fast_sweeping, false);
+        if (use_dijkstra && use_fast_sweeping)
+        {
+            int sweeping_threads;
+            private_nh.param("p10", sweeping_threads, 0);
+            FastSweepingExpansion* fse = new FastSweepingExpansion(p_calc_, cx, cy, sweeping_threads);
+            if(!old_navfn_behavior_)
+                fse->setPreciseStart(true);
+            planner_ = fse;
+        } else if (use_dijkstra)
         {
             DijkstraExpansion* de = new DijkstraExpansion(p_calc_, cx, cy);
             if(!old_navfn_behavior_)
@@ -207,6 +228,11 @@ void GlobalPlanner::initialize(std::string name, costmap_2d::Costmap2D* costmap,
         private_nh.param("planner_window_x", planner_window_x_, 0.0);
         private_nh.param("planner_window_y", planner_window_y_, 0.0);
         private_nh.param("default_tolerance", default_tolerance_, 0.0);
+        private_nh.param("p8", window_margin_, 2.0);
+        // only fully expanded potentials can be repaired
+        repairable_ = use_dijkstra;
+        private_nh.param("p11", incremental_, false);
+        incremental_ = incremental_ && repairable_;
         private_nh.param("publish_scale", publish_scale_, 100);
 
         int lethal_cost, neutral_cost, orientation_mode;
@@ -375,12 +401,7 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
     clearRobotCell(start_pose, start_x_i, start_y_i);
 
     int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
-
-    //make sure to resize the underlying array that Navfn uses
-    p_calc_->setSize(nx, ny);
-    planner_->setSize(nx, ny);
-    path_maker_->setSize(nx, ny);
-    potential_array_ = new float[nx * ny];
+    setSize(nx, ny);
 
     outlineMap(costmap_->getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
 
@@ -388,9 +409,51 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
     if (path_costmap_ != NULL) {
       path_costs = path_costmap_->getCharMap();
     }
-    bool found_legal = planner_->calculatePotentials(costmap_ros_, costmap_->getCharMap(), path_costs, start_x, start_y, goal_x, goal_y,
+
+    bool found_legal;
+    if (incremental_) {
+        found_legal = calculateGoalPotential(goal_x, goal_y, start_x_i + start_y_i * nx, path_costs);
+        if(publish_potential_)
+            publishPotential(potential_array_);
+
+        if (!found_legal || !getPlanFromGoalPotential(start_x, start_y, start_x_i, start_y_i, goal_x, goal_y, goal, plan))
+            GAUSSIAN_ERROR("Failed to get a global plan.");
+
+        orientation_filter_->processPath(start, plan);
+        publishPlan(plan);
+        return !plan.empty();
+    }
+
+    // the potential below is from the start, not one of the goal to keep
+    goal_potential_valid_ = false;
+
+    //calculate potentials within a window around start and goal first, and double it until it covers the map
+    //if start and goal aren't connected within it
+    int x0 = 0, y0 = 0, x1 = nx - 1, y1 = ny - 1;
+    if (window_margin_ > 0.0) {
+        int margin = (int)(window_margin_ / costmap_->getResolution());
+        x0 = std::max((int)std::min(start_x_i, goal_x_i) - margin, 0);
+        y0 = std::max((int)std::min(start_y_i, goal_y_i) - margin, 0);
+        x1 = std::min((int)std::max(start_x_i, goal_x_i) + margin, nx - 1);
+        y1 = std::min((int)std::max(start_y_i, goal_y_i) + margin, ny - 1);
+    }
+    while (true) {
+        planner_->setWindow(x0, y0, x1, y1);
+        path_maker_->setWindow(x0, y0, x1, y1);
+        found_legal = planner_->calculatePotentials(costmap_ros_, costmap_->getCharMap(), path_costs, start_x, start_y, goal_x, goal_y,
                                                     nx * ny * 2, potential_array_);
 
+        if (found_legal || (x0 == 0 && y0 == 0 && x1 == nx - 1 && y1 == ny - 1))
+            break;
+
+        int w = x1 - x0 + 1, h = y1 - y0 + 1;
+        x0 = std::max(x0 - w / 2, 0);
+        y0 = std::max(y0 - h / 2, 0);
+        x1 = std::min(x1 + w - w / 2, nx - 1);
+        y1 = std::min(y1 + h - h / 2, ny - 1);
+        GAUSSIAN_INFO("[Global Planner] goal not reached within the window, double it to [%d, %d] x [%d, %d]", x0, x1, y0, y1);
+    }
+
     if(!old_navfn_behavior_)
         planner_->clearEndpoint(costmap_->getCharMap(), potential_array_, goal_x_i, goal_y_i, 2);
     if(publish_potential_)
@@ -415,10 +478,197 @@ bool GlobalPlanner::makePlan(const geometry_msgs::PoseStamped& start, const geom
 
     //publish the plan for visualization purposes
     publishPlan(plan);
-    delete potential_array_;
     return !plan.empty();
 }
 
+int GlobalPlanner::makePlans(const std::vector<geometry_msgs::PoseStamped>& starts, const geometry_msgs::PoseStamped& goal,
+                             std::vector<double>& costs, std::vector<std::vector<geometry_msgs::PoseStamped> >* plans) {
+    boost::mutex::scoped_lock lock(mutex_);
+    costs.assign(starts.size(), POT_HIGH);
+    if (plans)
+        plans->assign(starts.size(), std::vector<geometry_msgs::PoseStamped>());
+    if (!initialized_) {
+        GAUSSIAN_ERROR(
+                "This planner has not been initialized yet, but it is being used, please call initialize() before use");
+        return 0;
+    }
+    if (!repairable_) {
+        GAUSSIAN_ERROR("[Global Planner] plans from several starts need the potential of the whole map, use Dijkstra");
+        return 0;
+    }
+
+    std::string global_frame = frame_id_;
+    if (tf::resolve(tf_prefix_, goal.header.frame_id) != tf::resolve(tf_prefix_, global_frame)) {
+        GAUSSIAN_ERROR(
+                "The goal pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", tf::resolve(tf_prefix_, global_frame).c_str(), tf::resolve(tf_prefix_, goal.header.frame_id).c_str());
+        return 0;
+    }
+
+    unsigned int goal_x_i, goal_y_i;
+    double goal_x, goal_y;
+    if (!costmap_->worldToMap(goal.pose.position.x, goal.pose.position.y, goal_x_i, goal_y_i)) {
+        ROS_WARN_THROTTLE(1.0,
+                "The goal sent to the global planner is off the global costmap. Planning will always fail to this goal.");
+        return 0;
+    }
+    if(old_navfn_behavior_){
+        goal_x = goal_x_i;
+        goal_y = goal_y_i;
+    }else{
+        worldToMap(goal.pose.position.x, goal.pose.position.y, goal_x, goal_y);
+    }
+
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    setSize(nx, ny);
+    outlineMap(costmap_->getCharMap(), nx, ny, costmap_2d::LETHAL_OBSTACLE);
+
+    unsigned char* path_costs = NULL;
+    if (path_costmap_ != NULL) {
+      path_costs = path_costmap_->getCharMap();
+    }
+
+    // the kept potential is only repaired with p11, otherwise it's computed again like in makePlan
+    if (!incremental_)
+        goal_potential_valid_ = false;
+
+    // every start needs its potential final, so nothing is left to repair
+    if (!calculateGoalPotential(goal_x, goal_y, -1, path_costs)) {
+        GAUSSIAN_ERROR("Failed to get the potential of the goal.");
+        return 0;
+    }
+    if(publish_potential_)
+        publishPotential(potential_array_);
+
+    int reachable = 0;
+    for (size_t k = 0; k < starts.size(); k++) {
+        const geometry_msgs::PoseStamped& start = starts[k];
+        if (tf::resolve(tf_prefix_, start.header.frame_id) != tf::resolve(tf_prefix_, global_frame)) {
+            GAUSSIAN_ERROR(
+                    "The start pose passed to this planner must be in the %s frame.  It is instead in the %s frame.", tf::resolve(tf_prefix_, global_frame).c_str(), tf::resolve(tf_prefix_, start.header.frame_id).c_str());
+            continue;
+        }
+
+        unsigned int start_x_i, start_y_i;
+        double start_x, start_y;
+        if (!costmap_->worldToMap(start.pose.position.x, start.pose.position.y, start_x_i, start_y_i))
+            continue;
+        if(old_navfn_behavior_){
+            start_x = start_x_i;
+            start_y = start_y_i;
+        }else{
+            worldToMap(start.pose.position.x, start.pose.position.y, start_x, start_y);
+        }
+
+        float potential = potential_array_[start_x_i + start_y_i * nx];
+        if (potential >= POT_HIGH)
+            continue;
+        costs[k] = potential;
+        reachable++;
+
+        if (plans) {
+            std::vector<geometry_msgs::PoseStamped>& plan = (*plans)[k];
+            if (getPlanFromGoalPotential(start_x, start_y, start_x_i, start_y_i, goal_x, goal_y, goal, plan))
+                orientation_filter_->processPath(start, plan);
+            else
+                GAUSSIAN_WARN("[Global Planner] start %zu reaches the goal, but no plan could be traced from it", k);
+        }
+    }
+    GAUSSIAN_INFO("[Global Planner] %d of %zu starts reach the goal", reachable, starts.size());
+    return reachable;
+}
+
+void GlobalPlanner::setSize(int nx, int ny) {
+    //make sure to resize the underlying array that Navfn uses, only when the map changes
+    if (nx != nx_ || ny != ny_) {
+        nx_ = nx;
+        ny_ = ny;
+        p_calc_->setSize(nx, ny);
+        planner_->setSize(nx, ny);
+        path_maker_->setSize(nx, ny);
+        if (potential_array_)
+            delete[] potential_array_;
+        potential_array_ = new float[nx * ny];
+        goal_potential_valid_ = false;
+    }
+}
+
+bool GlobalPlanner::calculateGoalPotential(double goal_x, double goal_y, int start_i, unsigned char* path_costs) {
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    unsigned char* costs = costmap_->getCharMap();
+    planner_->setWindow(0, 0, nx - 1, ny - 1);
+    path_maker_->setWindow(0, 0, nx - 1, ny - 1);
+
+    // past a 64th of the map, expanding it again is about as cheap
+    int max_cells = nx * ny / 64;
+    // a moved or another costmap shares no cells with the kept potential
+    if (goal_potential_valid_ && costmap_ == goal_potential_costmap_ && goal_x == goal_potential_x_ && goal_y == goal_potential_y_
+            && costmap_->getOriginX() == goal_potential_origin_x_ && costmap_->getOriginY() == goal_potential_origin_y_
+            && findChangedCells(costs, nx * ny, max_cells)
+            && planner_->repairPotentials(costs, changed_cells_, start_i, max_cells, potential_array_))
+        return true;
+
+    planner_->clearRepair();
+    goal_potential_valid_ = planner_->calculatePotentials(costmap_ros_, costs, path_costs, goal_x, goal_y, -1, -1,
+                                                          nx * ny * 2, potential_array_);
+    goal_potential_x_ = goal_x;
+    goal_potential_y_ = goal_y;
+    goal_potential_costmap_ = costmap_;
+    goal_potential_origin_x_ = costmap_->getOriginX();
+    goal_potential_origin_y_ = costmap_->getOriginY();
+    goal_potential_costs_.assign(costs, costs + nx * ny);
+    return goal_potential_valid_;
+}
+
+bool GlobalPlanner::findChangedCells(const unsigned char* costs, int ns, int max_cells) {
+    // blocks of equal costs are skipped by memcmp, only those which differ are walked
+    const int block = 64;
+    changed_cells_.clear();
+    for (int i = 0; i < ns; i += block) {
+        int n = std::min(block, ns - i);
+        if (memcmp(costs + i, &goal_potential_costs_[i], n) == 0)
+            continue;
+        for (int k = i; k < i + n; k++) {
+            if (costs[k] == goal_potential_costs_[k])
+                continue;
+            if ((int)changed_cells_.size() >= max_cells)
+                return false;
+            changed_cells_.push_back(k);
+            goal_potential_costs_[k] = costs[k];
+        }
+    }
+    return true;
+}
+
+bool GlobalPlanner::getPlanFromGoalPotential(double start_x, double start_y, unsigned int start_x_i, unsigned int start_y_i,
+                                             double goal_x, double goal_y, const geometry_msgs::PoseStamped& goal,
+                                             std::vector<geometry_msgs::PoseStamped>& plan) {
+    int nx = costmap_->getSizeInCellsX(), ny = costmap_->getSizeInCellsY();
+    int x0 = std::max((int)start_x_i - 2, 0), y0 = std::max((int)start_y_i - 2, 0);
+    int x1 = std::min((int)start_x_i + 2, nx - 1), y1 = std::min((int)start_y_i + 2, ny - 1);
+
+    // the potential is kept, so the cells set for the traceback are put back after it
+    float endpoint_potential[5][5];
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+            endpoint_potential[y - y0][x - x0] = potential_array_[x + y * nx];
+    if(!old_navfn_behavior_)
+        planner_->clearEndpoint(costmap_->getCharMap(), potential_array_, start_x_i, start_y_i, 2);
+
+    //the potential grows from the goal, the plan is traced from the start
+    bool found = getPlanFromPotential(goal_x, goal_y, start_x, start_y, goal, plan);
+    if (found) {
+        std::reverse(plan.begin(), old_navfn_behavior_ ? plan.end() - 1 : plan.end());
+        geometry_msgs::PoseStamped goal_copy = goal;
+        goal_copy.header.stamp = ros::Time::now();
+        plan.push_back(goal_copy);
+    }
+
+    for (int y = y0; y <= y1; y++)
+        for (int x = x0; x <= x1; x++)
+            potential_array_[x + y * nx] = endpoint_potential[y - y0][x - x0];
+    return found;
+}
+
 void GlobalPlanner::publishPlan(const std::vector<geometry_msgs::PoseStamped>& path) {
     if (!initialized_) {
         GAUSSIAN_ERROR(
@@ -0,0 +1,374 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+/**
+ * @file bucket_queue.h
+ * @brief bucket queue for pointers whose priority is a small integer key,
+ *        drop-in replacement of PointerHeap for the OPEN list of AD*.
+ *        pointers must have a heap_index field, like p->heap_index
+ */
+
+#ifndef SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_BUCKET_QUEUE_H_
+#define SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_BUCKET_QUEUE_H_
+
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+
+// for PTRHEAP_* return codes
+#include "search_based_global_planner/pointer_heap.h"
+
+#define BKTQUEUE_BUCKET_BITS 16
+#define BKTQUEUE_NUM_BUCKETS (1 << BKTQUEUE_BUCKET_BITS)
+#define BKTQUEUE_BUCKET_MASK (BKTQUEUE_NUM_BUCKETS - 1)
+#define BKTQUEUE_NIL UINT32_MAX
+
+/**
+ * @brief min queue of pointers, bucketed by the integer key returned by _KeyOf.
+ *
+ * Keys inside a window of BKTQUEUE_NUM_BUCKETS values starting at base_ go to
+ * one bucket per key (circular), larger keys go to an overflow list which is
+ * redistributed when the window runs empty. A two-level bitmap finds the
+ * first non-empty bucket, and each bucket is a binary heap by _Comp, so ties
+ * of bucket key are broken by its root instead of a scan of the bucket. Keys
+ * may decrease below the current minimum, which just moves the window back,
+ * so it also works for the non-monotone keys of AD*.
+ * p->heap_index holds the index of the queue node of p.
+ **/
+template<typename _Tp, typename _Comp, typename _KeyOf>
+class BucketQueue {
+ public:
+  typedef     _Tp             _Type;      ///< data type
+  typedef     _Comp           _Compare;   ///< compare function
+  typedef     _KeyOf          _Key;       ///< bucket key function
+
+ private:
+  typedef struct {
+    _Type data;
+    uint32_t key;          ///< bucket key when it's inserted
+    uint32_t pos;          ///< position in bucket heap or overflow list
+    bool in_overflow;
+  } Node;
+
+  _Compare                          __compare;
+  _Key                              __key_of;
+  std::vector<Node>                 __nodes;
+  std::vector<uint32_t>             __free_nodes;
+  std::vector<std::vector<uint32_t> > __buckets;  ///< binary heaps of nodes by _Comp
+  std::vector<uint64_t>             __bitmap;      ///< one bit per bucket
+  std::vector<uint64_t>             __summary;     ///< one bit per word of __bitmap
+  std::vector<uint32_t>             __overflow;
+  uint32_t                          __overflow_min;  ///< lower bound of keys in overflow
+  uint32_t                          __base;          ///< lower bound of keys in window
+  uint32_t                          __window_max;    ///< upper bound of keys in window
+  size_t                            __window_size;
+  size_t                            __size;
+  uint32_t                          __top;           ///< cached node of top(), or NIL
+
+ public:
+  BucketQueue()
+    : __buckets(BKTQUEUE_NUM_BUCKETS),
+      __bitmap(BKTQUEUE_NUM_BUCKETS / 64, 0),
+      __summary(BKTQUEUE_NUM_BUCKETS / 64 / 64, 0),
+      __overflow_min(UINT32_MAX), __base(0), __window_max(0),
+      __window_size(0), __size(0), __top(BKTQUEUE_NIL) {
+    // do nothing
+  }
+
+  /**
+   * @brief Remove all elements
+   **/
+  int clear() {
+    for (uint32_t i = 0; i < __nodes.size(); ++i) {
+      if (__nodes[i].data != NULL) __nodes[i].data->heap_index = -1;
+    }
+    __nodes.clear();
+    __free_nodes.clear();
+    __clear_buckets();
+    return PTRHEAP_OK;
+  }
+
+  inline size_t size() const {
+    return __size;
+  }
+
+  bool empty() const {
+    return __size == 0;
+  }
+
+  /**
+   * @brief Total capacity of the containers, it changes when any of them grows
+   **/
+  size_t capacity() const {
+    size_t capacity = __nodes.capacity() + __free_nodes.capacity() + __buckets.capacity() +
+                      __bitmap.capacity() + __summary.capacity() + __overflow.capacity();
+    for (uint32_t i = 0; i < __buckets.size(); ++i) capacity += __buckets[i].capacity();
+    return capacity;
+  }
+
+  /**
+   * @brief Return the element with the smallest key, NULL when empty
+   **/
+  _Type top() {
+    if (__size == 0) return NULL;
+    if (__top == BKTQUEUE_NIL) __find_top();
+    return __nodes[__top].data;
+  }
+
+  /**
+   * @brief Pop the element with the smallest key
+   **/
+  int pop() {
+    if (__size == 0) return PTRHEAP_EMPTY;
+    if (__top == BKTQUEUE_NIL) __find_top();
+    __erase(__top);
+    return PTRHEAP_OK;
+  }
+
+  /**
+   * @brief check if data is in the queue
+   **/
+  int contain(const _Type& data) {
+    if (data == NULL) return PTRHEAP_PARAM_NULL;
+    if (__size == 0) return PTRHEAP_EMPTY;
+    if (data->heap_index < 0 || (size_t)data->heap_index >= __nodes.size()) return PTRHEAP_PARAM_INV_INDEX;
+    if (__nodes[data->heap_index].data != data) return PTRHEAP_DATA_NOT_EXIST;
+    return PTRHEAP_OK;
+  }
+
+  /**
+   * @brief Push the new element to the queue
+   **/
+  int push(const _Type& data) __must_check {
+    if (data == NULL) return PTRHEAP_PARAM_NULL;
+
+    uint32_t index;
+    if (!__free_nodes.empty()) {
+      index = __free_nodes.back();
+      __free_nodes.pop_back();
+    } else {
+      index = __nodes.size();
+      __nodes.push_back(Node());
+    }
+    __nodes[index].data = data;
+    __nodes[index].key = __key_of(data);
+    data->heap_index = index;
+    ++__size;
+
+    if (__top != BKTQUEUE_NIL && __compare(data, __nodes[__top].data)) __top = BKTQUEUE_NIL;
+    __insert(index);
+    return PTRHEAP_OK;
+  }
+
+  /**
+   * @brief Move the element after its key changed
+   **/
+  int adjust(_Type& data) {
+    int retval = contain(data);
+    if (retval != PTRHEAP_OK) return retval;
+
+    uint32_t index = data->heap_index;
+    __unlink(index);
+    __nodes[index].key = __key_of(data);
+    __top = BKTQUEUE_NIL;
+    __insert(index);
+    return PTRHEAP_OK;
+  }
+
+  /**
+   * @brief Erase the element data
+   **/
+  int erase(const _Type& data) __must_check {
+    int retval = contain(data);
+    if (retval != PTRHEAP_OK) return retval;
+
+    __erase(data->heap_index);
+    return PTRHEAP_OK;
+  }
+
+  /**
+   * @brief Call update on every element, then redistribute all of them by
+   *        their new keys, O(n) and no comparisons
+   **/
+  template<typename _Update>
+  void rekey(_Update update) {
+    for (uint32_t i = 0; i < __nodes.size(); ++i) {
+      if (__nodes[i].data == NULL) continue;
+      update(__nodes[i].data);
+      __nodes[i].key = __key_of(__nodes[i].data);
+    }
+    __rebase_to_min();
+  }
+
+ private:
+  void __clear_buckets() {
+    for (uint32_t w = 0; w < __bitmap.size(); ++w) {
+      uint64_t bits = __bitmap[w];
+      while (bits) {
+        __buckets[(w << 6) + __builtin_ctzll(bits)].clear();
+        bits &= bits - 1;
+      }
+      __bitmap[w] = 0;
+    }
+    std::fill(__summary.begin(), __summary.end(), 0);
+    __overflow.clear();
+    __overflow_min = UINT32_MAX;
+    __window_size = 0;
+    __size = 0;
+    __top = BKTQUEUE_NIL;
+  }
+
+  // put node to window or overflow according to its key, moving window back if needed
+  void __insert(uint32_t index) {
+    uint32_t key = __nodes[index].key;
+    if (key < __overflow_min) {
+      if (__window_size == 0) {
+        __base = __window_max = key;
+      } else if (key < __base) {
+        if (__window_max - key >= BKTQUEUE_NUM_BUCKETS) {
+          // window can't move back that far, redistribute all
+          __rebase(key);
+          return;
+        }
+        __base = key;
+      }
+    }
+    __place(index);
+  }
+
+  // put node to window or overflow according to its key, window is not moved
+  void __place(uint32_t index) {
+    Node& node = __nodes[index];
+    uint32_t key = node.key;
+
+    if (key < __overflow_min && key - __base < BKTQUEUE_NUM_BUCKETS) {
+      uint32_t b = key & BKTQUEUE_BUCKET_MASK;
+      node.in_overflow = false;
+      node.pos = __buckets[b].size();
+      __buckets[b].push_back(index);
+      __sift_up(__buckets[b], node.pos);
+      __bitmap[b >> 6] |= 1ull << (b & 63);
+      __summary[b >> 12] |= 1ull << ((b >> 6) & 63);
+      if (key > __window_max) __window_max = key;
+      ++__window_size;
+      return;
+    }
+
+    node.in_overflow = true;
+    node.pos = __overflow.size();
+    __overflow.push_back(index);
+    if (key < __overflow_min) __overflow_min = key;
+  }
+
+  // remove node from its bucket or overflow list, node is kept
+  void __unlink(uint32_t index) {
+    Node& node = __nodes[index];
+    std::vector<uint32_t>& list = node.in_overflow ? __overflow : __buckets[node.key & BKTQUEUE_BUCKET_MASK];
+    uint32_t last = list.back();
+    list[node.pos] = last;
+    __nodes[last].pos = node.pos;
+    list.pop_back();
+    if (node.in_overflow) return;
+
+    // last node took the place of the removed one in the bucket heap
+    if (last != index) {
+      __sift_up(list, __nodes[last].pos);
+      __sift_down(list, __nodes[last].pos);
+    }
+    --__window_size;
+    if (list.empty()) {
+      uint32_t b = node.key & BKTQUEUE_BUCKET_MASK;
+      __bitmap[b >> 6] &= ~(1ull << (b & 63));
+      if (__bitmap[b >> 6] == 0) __summary[b >> 12] &= ~(1ull << ((b >> 6) & 63));
+    }
+  }
+
+  void __erase(uint32_t index) {
+    __unlink(index);
+    __nodes[index].data->heap_index = -1;
+    __nodes[index].data = NULL;
+    __free_nodes.push_back(index);
+    --__size;
+    if (__top == index) __top = BKTQUEUE_NIL;
+  }
+
+  // redistribute all nodes with window starting at base
+  void __rebase(uint32_t base) {
+    size_t size = __size;
+    __clear_buckets();
+    __size = size;
+    __base = __window_max = base;
+    for (uint32_t i = 0; i < __nodes.size(); ++i) {
+      if (__nodes[i].data != NULL) __place(i);
+    }
+  }
+
+  void __rebase_to_min() {
+    uint32_t min_key = UINT32_MAX;
+    for (uint32_t i = 0; i < __nodes.size(); ++i) {
+      if (__nodes[i].data != NULL) min_key = std::min(min_key, __nodes[i].key);
+    }
+    __rebase(min_key);
+  }
+
+  // first non-empty bucket at or after bucket b, circularly, window must not be empty
+  uint32_t __next_bucket(uint32_t b) {
+    uint32_t w = b >> 6;
+    uint64_t bits = __bitmap[w] & (~0ull << (b & 63));
+    if (bits) return (w << 6) + __builtin_ctzll(bits);
+
+    uint32_t num_of_words = __bitmap.size();
+    uint32_t s = (w + 1) & (num_of_words - 1);
+    for (uint32_t n = 0; n <= __summary.size(); ++n) {
+      uint32_t i = s >> 6;
+      uint64_t words = __summary[i] & (~0ull << (s & 63));
+      if (words) {
+        w = (i << 6) + __builtin_ctzll(words);
+        return (w << 6) + __builtin_ctzll(__bitmap[w]);
+      }
+      s = ((i + 1) << 6) & (num_of_words - 1);
+    }
+    // only the bits of word b >> 6 before b are left
+    return (b & ~63u) + __builtin_ctzll(__bitmap[b >> 6]);
+  }
+
+  void __find_top() {
+    if (__window_size == 0) __rebase_to_min();
+
+    uint32_t b = __next_bucket(__base & BKTQUEUE_BUCKET_MASK);
+    __base += (b - __base) & BKTQUEUE_BUCKET_MASK;
+
+    __top = __buckets[b][0];
+  }
+
+  void __sift_up(std::vector<uint32_t>& heap, uint32_t pos) {
+    uint32_t index = heap[pos];
+    while (pos > 0) {
+      uint32_t parent = (pos - 1) >> 1;
+      if (!__compare(__nodes[index].data, __nodes[heap[parent]].data)) break;
+      heap[pos] = heap[parent];
+      __nodes[heap[pos]].pos = pos;
+      pos = parent;
+    }
+    heap[pos] = index;
+    __nodes[index].pos = pos;
+  }
+
+  void __sift_down(std::vector<uint32_t>& heap, uint32_t pos) {
+    uint32_t index = heap[pos];
+    uint32_t size = heap.size();
+    while (true) {
+      uint32_t child = 2 * pos + 1;
+      if (child >= size) break;
+      if (child + 1 < size && __compare(__nodes[heap[child + 1]].data, __nodes[heap[child]].data)) ++child;
+      if (!__compare(__nodes[heap[child]].data, __nodes[index].data)) break;
+      heap[pos] = heap[child];
+      __nodes[heap[pos]].pos = pos;
+      pos = child;
+    }
+    heap[pos] = index;
+    __nodes[index].pos = pos;
+  }
+};
+
+#endif  // SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_BUCKET_QUEUE_H_
@@ -12,48 +12,55 @@
 #ifndef SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_ENVIRONMENT_H_
 #define SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_ENVIRONMENT_H_
 
+#include <stdint.h>
 #include <vector>
+#include <string>
 #include <gslib/gaussian_debug.h>
 #include "search_based_global_planner/utils.h"
 #include "search_based_global_planner/pointer_heap.h"
 #include "search_based_global_planner/motion_primitive_manager.h"
 
 #define NUM_OF_HEURISTIC_SEARCH_DIR 16
+// 2D heuristic is computed from scratch if more than 1/N of the window changed
+#define MAX_HEURISTIC_REPAIR_CELLS_DIVISOR 32
+// cost of cells which are not safe for the center of robot in cell_costs_
+#define CELL_COST_UNSAFE 0xFF
+// clearance is computed from scratch if safety of more than 1/N of the window changed
+#define MAX_CLEARANCE_REPAIR_CELLS_DIVISOR 256
 
 namespace search_based_global_planner {
 
-#define XYTHETA2INDEX(x, y, theta) (theta + x * num_of_angles_ + y * size_x_ * num_of_angles_)
+// states are allocated in tiles of ENTRY_TILE_SIZE x ENTRY_TILE_SIZE cells with all angles
+#define ENTRY_TILE_SHIFT 3
+#define ENTRY_TILE_SIZE (1 << ENTRY_TILE_SHIFT)
+#define ENTRY_TILE_MASK (ENTRY_TILE_SIZE - 1)
+#define INITIAL_ENTRY_HASH_BITS 10
+#define INITIAL_ENTRY_HASH_SIZE (1 << INITIAL_ENTRY_HASH_BITS)
+// bits of EnvironmentEntry3D::endpoint
+#define ENDPOINT_START_SET 1
+#define ENDPOINT_GOAL_SET 2
 
 typedef struct {
   int x;
   int y;
-  int heuristic;
+  int heuristic;  // g value of the 2D search
+  int rhs;        // one-step lookahead of heuristic
+  int key;        // min(heuristic, rhs) when in grid_open_
   unsigned char cost;
 
   int heap_index;
   int visited_iteration;
 } EnvironmentEntry2D;
 
+// hot part of a lattice state: everything touched by key computation and heap
+// operations, kept small so that OPEN and the arena stay cache friendly
 typedef struct _EnvironmentEntry3D {
-  int x;
-  int y;
-  uint8_t theta;
+  uint32_t g;
+  uint32_t rhs;
 
-  uint64_t g;
-  uint64_t rhs;
-
-  _EnvironmentEntry3D* best_next_entry;
-
-  int heap_index;
-  int visited_iteration;  // assign to iteration number
-                          // so if it equals to iteration_number, this
-                          // entry is visited before
-  int closed_iteration;   // assign to interation number
-                          // so if it equals to iteration_number, this
-                          // entry is closed in this iteration
   struct _Key {
-    uint64_t k1;
-    uint64_t k2;
+    uint32_t k1;
+    uint32_t k2;
 
     _Key() : k1(0), k2(0) { }
     bool operator<(const _Key& k) const {
@@ -64,24 +71,58 @@ typedef struct _EnvironmentEntry3D {
     }
   } key;
 
+  int heap_index;
+
+  int16_t x;
+  int16_t y;
+  uint8_t theta;
+  uint8_t endpoint;  // ENDPOINT_* bits of start and goal sets it's in
+
+  uint32_t slot;  // position in the tile pool, locates the cold part
+
   _Key ComputeKey(double eps_satisfied, int heuristic) {
     if (g > rhs) {
-      key.k1 = rhs + eps_satisfied * heuristic;
+      key.k1 = SaturateKey(rhs + eps_satisfied * heuristic);
       key.k2 = rhs;
     } else {
-      key.k1 = g + heuristic;
+      key.k1 = SaturateKey(static_cast<double>(g) + heuristic);
       key.k2 = g;
     }
     return key;
   }
+  static uint32_t SaturateKey(double k) {
+    if (k <= 0) return 0;
+    return k >= UINT32_MAX ? UINT32_MAX : static_cast<uint32_t>(k);
+  }
   bool operator==(const _EnvironmentEntry3D& e) const { return x == e.x && y == e.y && theta == e.theta; }
   bool operator!=(const _EnvironmentEntry3D& e) const { return !operator==(e); }
 } EnvironmentEntry3D;
 
+// cold part of a lattice state, stored in a parallel pool indexed by the
+// same slot, only touched when a state is visited, closed or traced back
+typedef struct {
+  EnvironmentEntry3D* best_next_entry;
+  Action* best_action;    // action leading to best_next_entry, NULL if unknown
+  int visited_iteration;  // assign to iteration number
+                          // so if it equals to iteration_number, this
+                          // entry is visited before
+  int closed_iteration;   // assign to interation number
+                          // so if it equals to iteration_number, this
+                          // entry is closed in this iteration
+  unsigned int inconsist_epoch;  // equals to epoch of INCONS list of planner if it's in
+  bool unverified;        // cost of best_action is only a lower bound so far, see lazy evaluation
+} EnvironmentEntry3DCold;
+
+typedef struct {
+  uint32_t id;     // tile id, state id with the low bits of x, y and theta dropped
+  uint32_t tile;   // index of the tile in pool
+  uint32_t epoch;  // bucket is empty unless epoch equals Environment::epoch_
+} EntryHashBucket;
+
 class HeuristicComparator {
  public:
   bool operator()(const EnvironmentEntry2D* lhs, const EnvironmentEntry2D* rhs) const {
-    return lhs->heuristic < rhs->heuristic;
+    return lhs->key < rhs->key;
   }
 };
 
@@ -94,32 +135,110 @@ class Environment {
               double timetoturn45degsinplace_secs,
               const std::vector<XYPoint>& footprint, const std::vector<XYPoint>& circle_center,
               int num_of_angles, int num_of_prims_per_angle, int forward_cost_mult,
-              int forward_and_turn_cost_mult, int turn_in_place_cost_mult);
+              int forward_and_turn_cost_mult, int turn_in_place_cost_mult,
+              int free_space_heuristic_radius, int long_range_clearance, const std::string& mprim_cache_dir);
   ~Environment();
 
   void ReInitialize();
   EnvironmentEntry3D* SetStart(double x_m, double y_m, double theta_rad);
   EnvironmentEntry3D* SetGoal(double x_m, double y_m, double theta_rad);
   void UpdateCost(unsigned int x, unsigned int y, unsigned char cost);
-  void GetPreds(EnvironmentEntry3D* entry, std::vector<EnvironmentEntry3D*>* pred_entries, std::vector<int>* costs);
+  // with optimistic, costs of preds are lower bounds which only look at the
+  // cells action starts and ends in, no footprint walk. They could be
+  // evaluated later by GetActionCost
+  void GetPreds(EnvironmentEntry3D* entry, std::vector<EnvironmentEntry3D*>* pred_entries,
+                std::vector<int>* costs, std::vector<Action*>* actions = NULL, bool optimistic = false);
   void GetSuccs(EnvironmentEntry3D* entry, std::vector<EnvironmentEntry3D*>* succ_entries,
                 std::vector<int>* costs, std::vector<Action*>* actions = NULL);
   void EnsureHeuristicsUpdated();
+  // move the window by dx, dy cells, multiples of ENTRY_TILE_SIZE: cell x, y
+  // takes over cost and lattice states of cell x + dx, y + dy, cells exposed
+  // by the move are obstacles until UpdateCost. Entries which fall out of the
+  // window go to dropped_entries, entries whose actions may cross the old or
+  // new border of the window go to border_entries, both could be NULL
+  void ShiftWindow(int dx, int dy, std::vector<EnvironmentEntry3D*>* dropped_entries,
+                   std::vector<EnvironmentEntry3D*>* border_entries);
+  // use only motion primitives whose bit 1 << MprimIndex is set in mask for
+  // succs and preds, all of them by default
+  void SetPrimitiveMask(unsigned int mask);
+  // sets of start and goal states: a virtual super start is the pred of every
+  // state of start set and a virtual super goal is the only succ of every
+  // state of goal set, both at no cost. Search is rooted at super goal and
+  // terminates at super start, so its termination check is one comparison
+  // however large the sets are. Virtual states are reset by ReInitialize,
+  // SetStartSet returns true if the set changed
+  bool SetStartSet(const std::vector<EnvironmentEntry3D*>& entries);
+  void SetGoalSet(const std::vector<EnvironmentEntry3D*>& entries);
+  EnvironmentEntry3D* GetSuperStart() { return super_start_; }
+  EnvironmentEntry3D* GetSuperGoal() { return super_goal_; }
+  // whether heuristic takes the free space lattice cost from start, it's
+  // taken effect by SetStart
+  void UseFreeSpaceHeuristic(bool use) { use_free_space_heuristic_ = use; }
+  // bring cells offering LONG_RANGE_FORWARD up to date with the costs, cells
+  // which start or stop offering it go to changed_cells, could be NULL
+  void UpdateLongRangeCells(std::vector<XYCell>* changed_cells);
+  // ratio of cells with cost > 0 in the box, clipped to window, as of last
+  // UpdateLongRangeCells
+  double GetCostCellRatio(int min_x, int min_y, int max_x, int max_y);
+  // bring distances to unsafe cells up to date with the costs, from cells
+  // whose safety changed, must be done after UpdateCost before actions are costed
+  void UpdateClearance();
 
+  // get entry of (x, y, theta), create it if it's not generated in this plan yet
   EnvironmentEntry3D* GetEnvEntry(unsigned int x, unsigned int y, unsigned int theta) {
     if (!IsWithinMapCell(x, y) || theta >= num_of_angles_) return NULL;
-    return &env_[x][y][theta];
+    EnvironmentEntry3D* tile = GetTile(x, y, true);
+    return &tile[LocalIndex(x, y, theta)];
   }
+  // get entry of (x, y, theta) only if its tile has been generated in this plan
+  EnvironmentEntry3D* FindEnvEntry(unsigned int x, unsigned int y, unsigned int theta) {
+    if (!IsWithinMapCell(x, y) || theta >= num_of_angles_) return NULL;
+    EnvironmentEntry3D* tile = GetTile(x, y, false);
+    return tile != NULL ? &tile[LocalIndex(x, y, theta)] : NULL;
+  }
+  EnvironmentEntry3DCold* GetColdEntry(const EnvironmentEntry3D* entry) {
+    return &cold_tiles_[entry->slot >> tile_entry_shift_][entry->slot & ((1 << tile_entry_shift_) - 1)];
+  }
+  // upper bound of slot of entries generated in this plan
+  unsigned int GetNumOfEntries() { return num_of_tiles_ << tile_entry_shift_; }
+  // heap allocations of the entry pool, its hash and scratch buffers so far
+  unsigned int GetNumOfAllocations();
+  // upper bound of succs or preds of an entry
+  unsigned int GetMaxNumOfActions();
+  const Action* GetAction(int theta, int mprim_index) { return actions_[theta][mprim_index]; }
+  // true cost of action from entry, INFINITECOST if it collides
+  int GetActionCost(const EnvironmentEntry3D* entry, Action* action) {
+    return ComputeActionCost(entry->x, entry->y, entry->theta, action);
+  }
+  // footprint walks of actions so far, they only increase
+  unsigned int GetNumOfCollisionChecks() { return num_of_collision_checks_; }
   unsigned char GetCost(unsigned int x, unsigned int y) {
     if (!IsWithinMapCell(x, y)) return obstacle_threshold_;
     return grid_[x][y].cost;
   }
-  int GetHeuristic(unsigned int x, unsigned int y) {
+  int GetHeuristic(unsigned int x, unsigned int y, unsigned int theta) {
+    // virtual states are out of map, super start is where heuristic is 0
+    if (!IsWithinMapCell(x, y)) return 0;
     int h_2d = (grid_[x][y].visited_iteration == iteration_ &&
                 grid_[x][y].heuristic <= largest_computed_heuristic_) ? grid_[x][y].heuristic : largest_computed_heuristic_;
     // use millimeters, so multiply by 1000
     int h_euclid = static_cast<int>(1000 * resolution_ * hypot(static_cast<int>(start_cell_.x) - static_cast<int>(x), static_cast<int>(start_cell_.y) - static_cast<int>(y)));
-    return static_cast<int>(std::max(h_2d, h_euclid) / nominalvel_mpersec_);
+    int h = static_cast<int>(std::max(h_2d, h_euclid) / nominalvel_mpersec_);
+    // near start, lattice cost in free space knows about heading
+    if (start_free_space_heuristic_ != NULL) {
+      unsigned int dx = x - start_cell_.x + free_space_heuristic_radius_;
+      unsigned int dy = y - start_cell_.y + free_space_heuristic_radius_;
+      unsigned int width = 2 * free_space_heuristic_radius_ + 1;
+      if (dx < width && dy < width) {
+        h = std::max(h, start_free_space_heuristic_[(dy * width + dx) * num_of_angles_ + theta]);
+      } else {
+        // out of table, count turns to a heading moving towards (x, y) and then to theta
+        int cone = heading_cone_ids_[(static_cast<int>(y) - start_cell_.y + size_y_ - 1) * (2 * size_x_ - 1) +
+                                     static_cast<int>(x) - start_cell_.x + size_x_ - 1];
+        h = std::max(h, start_turn_costs_[cone * num_of_angles_ + theta]);
+      }
+    }
+    return h;
   }
   std::vector<XYThetaCell>& GetAffectedPredCells() { return affected_pred_cells_; }
 
@@ -133,10 +252,68 @@ class Environment {
   bool IsCellSafe(int x, int y) {
     return IsWithinMapCell(x, y) && grid_[x][y].cost < cost_inscribed_thresh_;
   }
+  // LONG_RANGE_FORWARD only starts from cells with enough clearance, away from goal
+  bool IsLongRangeCell(int x, int y) {
+    if (!IsWithinMapCell(x, y) || !long_range_cells_[x * size_y_ + y]) return false;
+    int dx = x - goal_cell_.x;
+    int dy = y - goal_cell_.y;
+    return dx * dx + dy * dy > long_range_goal_distance_sq_;
+  }
   bool IsValidConfiguration(int cell_x, int cell_y, int theta);
   void ComputeDXY();
+  void ComputeHeadingCones();
+  void ComputeStartTurnCosts(int start_theta);
   int ComputeActionCost(int source_x, int source_y, int source_theta, Action* action);
+  int ComputeActionCostWithinMap(int source_x, int source_y, Action* action);
+  int ComputeOptimisticActionCost(int source_x, int source_y, Action* action);
+  void ComputeClearance();
+  void RepairClearance();
+  unsigned char CellCostOf(unsigned char cost) {
+    return cost < cost_inscribed_thresh_ ? cost : CELL_COST_UNSAFE;
+  }
   bool ComputeHeuristicValues();
+  // entry of 2D search, reset if it's not touched since heuristics were last computed from scratch
+  EnvironmentEntry2D* GetHeuristicEntry(int x, int y) {
+    EnvironmentEntry2D* entry = &grid_[x][y];
+    if (entry->visited_iteration != iteration_) {
+      entry->visited_iteration = iteration_;
+      entry->heuristic = entry->rhs = INFINITECOST;
+      entry->heap_index = -1;
+    }
+    return entry;
+  }
+  int GetHeuristicEdgeCost(int x, int y, int dir);
+  void RecomputeHeuristicRHS(EnvironmentEntry2D* entry);
+  void UpdateHeuristicEntry(EnvironmentEntry2D* entry);
+
+  unsigned int LocalIndex(unsigned int x, unsigned int y, unsigned int theta) {
+    return theta + (((x & ENTRY_TILE_MASK) + ((y & ENTRY_TILE_MASK) << ENTRY_TILE_SHIFT)) << angle_bits_);
+  }
+  // tile containing cell (x, y), NULL if it's not created in this plan and create is false
+  EnvironmentEntry3D* GetTile(unsigned int x, unsigned int y, bool create) {
+    unsigned int id = (x >> ENTRY_TILE_SHIFT) + (y >> ENTRY_TILE_SHIFT) * size_tile_x_;
+    // successors and predecessors mostly stay in the tile of their source
+    if (id == last_tile_id_) return last_tile_;
+    EntryHashBucket* bucket = FindBucket(id);
+    if (bucket->epoch != epoch_) {
+      if (!create) return NULL;
+      bucket = CreateTile(bucket, id);
+    }
+    last_tile_id_ = id;
+    last_tile_ = entry_tiles_[bucket->tile];
+    return last_tile_;
+  }
+  // linear probing, returns either the bucket of id or the empty bucket where id should go
+  EntryHashBucket* FindBucket(unsigned int id) {
+    unsigned int index = (id * 2654435761u) >> hash_shift_;
+    while (hash_[index].epoch == epoch_ && hash_[index].id != id) index = (index + 1) & hash_mask_;
+    return &hash_[index];
+  }
+  EntryHashBucket* CreateTile(EntryHashBucket* bucket, unsigned int id);
+  void ResetVirtualEntries();
+  void SetEndpointSet(const std::vector<EnvironmentEntry3D*>& entries, uint8_t bit,
+                      std::vector<EnvironmentEntry3D*>* set);
+  void GrowHashTable();
 
  private:
   unsigned int size_x_;
@@ -146,8 +323,36 @@ class Environment {
   XYThetaCell start_cell_;
   XYThetaCell goal_cell_;
 
-  EnvironmentEntry3D*** env_;
+  // states are created lazily, a tile at a time, when first generated: an
+  // open-addressing hash maps tile id to a tile in a pool, so entry pointers
+  // stay valid while the hash grows. Buckets and tiles of earlier plans are
+  // invalidated by bumping epoch_, not by sweeping the window
+  std::vector<EnvironmentEntry3D*> entry_tiles_;
+  std::vector<EnvironmentEntry3DCold*> cold_tiles_;
+  unsigned int num_of_tiles_;
+  unsigned int num_of_allocations_;
+  unsigned int num_of_collision_checks_;
+  unsigned int size_tile_x_;
+  unsigned int angle_bits_;        // log2 of num_of_angles_ rounded up to power of 2
+  unsigned int tile_entry_shift_;  // log2 of number of entries in a tile
+  unsigned int last_tile_id_;
+  EnvironmentEntry3D* last_tile_;
+  EntryHashBucket* hash_;
+  unsigned int hash_mask_;
+  unsigned int hash_shift_;  // 32 - log2(size of hash_)
+  unsigned int epoch_;
+  std::vector<unsigned int> free_tiles_;  // pool tiles dropped by ShiftWindow
+  std::vector<EntryHashBucket> kept_tiles_;  // buffer of ShiftWindow
+  std::vector<size_t> buffer_capacities_;  // as of last GetNumOfAllocations
+  // super start and super goal are in pool tile 0, which is never hashed
+  EnvironmentEntry3D* super_start_;
+  EnvironmentEntry3D* super_goal_;
+  std::vector<EnvironmentEntry3D*> start_set_;
+  std::vector<EnvironmentEntry3D*> goal_set_;
   EnvironmentEntry2D** grid_;
+  // costs of grid_ packed x major for action checks, unsafe cells are
+  // CELL_COST_UNSAFE, so that checking an action is a max over bytes
+  unsigned char* cell_costs_;
 
   double resolution_;
   unsigned char obstacle_threshold_;
@@ -156,8 +361,11 @@ class Environment {
   std::vector<XYPoint> footprint_;
   std::vector<XYPoint> circle_center_;
 
-  // for computing heuristic
+  // for computing heuristic, 2D search is an LPA* rooted at start_cell_, it's
+  // repaired around heuristic_changed_cells_ unless start changes
   bool need_to_update_heuristics_;
+  bool need_to_recompute_heuristics_;
+  std::vector<XYCell> heuristic_changed_cells_;
   int iteration_;
   int largest_computed_heuristic_;
   int heuristic_dx_[NUM_OF_HEURISTIC_SEARCH_DIR];
@@ -178,9 +386,50 @@ class Environment {
   int num_of_angles_, num_of_prims_per_angle_;
   int forward_cost_mult_, forward_and_turn_cost_mult_, turn_in_place_cost_mult_;
   std::vector<std::vector<Action*>> actions_;
+  // actions of the primitive mask, by start theta and by end theta
+  std::vector<std::vector<Action*>> succ_actions_;
   std::vector<std::vector<Action*>> pred_actions_;
   std::vector<XYThetaCell> affected_succ_cells_;  // arrays of states whose outgoing actions cross cell 0,0
   std::vector<XYThetaCell> affected_pred_cells_;  // arrays of states whose incoming actions cross cell 0,0
+
+  // lattice cost from (0, 0, start theta) to (dx, dy, theta) in free space,
+  // within free_space_heuristic_radius_ cells, empty if disabled
+  std::vector<int> free_space_heuristic_;
+  int free_space_heuristic_radius_;
+  bool use_free_space_heuristic_;
+  const int* start_free_space_heuristic_;  // part of start_cell_.theta, or NULL
+  // out of the table: cone of an offset from start is the mask of headings
+  // with an action moving towards it, a path must turn to one of them
+  std::vector<uint8_t> heading_cone_ids_;  // by offset, (2 * size_y_ - 1) x (2 * size_x_ - 1)
+  std::vector<uint32_t> heading_cones_;
+  int turn_step_cost_;  // lower bound of cost of changing heading by one angle
+  int turn_costs_start_theta_;
+  std::vector<int> start_turn_costs_;  // by cone and theta, from start_cell_.theta
+
+  // cells with no cost > 0 within long_range_clearance_ cells, x major like
+  // cell_costs_, found with a summed area table of cells with cost > 0
+  int long_range_clearance_;          // negative if disabled
+  int long_range_goal_distance_sq_;   // squared length of LONG_RANGE_FORWARD in cells
+  bool need_to_update_long_range_cells_;
+  std::vector<uint8_t> long_range_cells_;
+  std::vector<int> cost_cell_sums_;
+
+  // squared distance in cells from each cell to the nearest unsafe cell of the
+  // window, x major like cell_costs_. It's saturated at clearance_cap_sq_,
+  // which is above every reach it's compared with, so a change only reaches
+  // the cells around it and is repaired from clearance_changed_cells_
+  std::vector<uint16_t> clearance_sq_;
+  int clearance_cap_sq_;
+  std::vector<XYCell> clearance_offsets_;  // with squared length below cap, shortest first
+  std::vector<int> footprint_reach_sq_;    // by theta, of the farthest footprint cell from center cell
+  bool need_to_recompute_clearance_;
+  std::vector<XYCell> clearance_changed_cells_;
+  std::vector<uint8_t> clearance_dirty_;
+  std::vector<int> clearance_dirty_cells_;
+  // buffers of ComputeClearance
+  std::vector<int> clearance_column_sq_;
+  std::vector<int> envelope_sites_;
+  std::vector<double> envelope_bounds_;
 };
 
 };  // namespace search_based_global_planner
@@ -0,0 +1,87 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+/**
+ * @file epsilon_tuner.h
+ * @brief learns per kind of plan how fast the cost of AD* converges over
+ *        epsilon rounds, and picks initial epsilon and stop time from it
+ */
+
+#ifndef SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_EPSILON_TUNER_H_
+#define SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_EPSILON_TUNER_H_
+
+#include <stdint.h>
+#include <vector>
+#include <string>
+
+#define EPSILON_TUNING_VERSION 1
+// plans are bucketed by distance from start to goal and by clutter between them
+#define NUM_OF_DISTANCE_BUCKETS 6
+#define NUM_OF_CLUTTER_BUCKETS 4
+// epsilon levels of one schedule: initial epsilon, 1 less, ..., 1
+#define MAX_EPSILON_LEVELS 8
+// a bucket is tuned after this many learning plans, and every
+// EPSILON_EXPLORATION_PERIOD-th plan of it still runs the full schedule to learn
+#define MIN_EPSILON_TUNING_SAMPLES 5
+#define EPSILON_EXPLORATION_PERIOD 10
+// weight of a new learning plan in the averages of its bucket
+#define EPSILON_TUNING_RATE 0.2
+// stop time is this many times the average time to reach the target cost
+#define EPSILON_STOP_TIME_MARGIN 1.5
+
+namespace search_based_global_planner {
+
+// what is learned of one bucket
+typedef struct {
+  uint32_t num_of_samples;
+  uint32_t num_of_plans;
+  double target_time;                          // since search started, until target cost is reached
+  double cost_ratio[MAX_EPSILON_LEVELS];       // cost of level / cost of epsilon 1
+} EpsilonTuningBucket;
+
+// header of the table file, followed by all buckets
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_of_levels;
+  double initial_epsilon;
+} EpsilonTuningHeader;
+
+class EpsilonTuner {
+ public:
+  EpsilonTuner();
+  ~EpsilonTuner();
+  // chosen schedules reach target_percentage of the cost at epsilon 1, i.e.
+  // that cost is at least target_percentage / 100 of theirs, 0 to disable.
+  // Initial epsilon is within [1, initial_epsilon] and stop time within
+  // [min_time, max_time]. The table is loaded from and saved to table_file,
+  // empty not to keep it
+  void Initialize(double initial_epsilon, double min_time, double max_time,
+                  double target_percentage, const std::string& table_file);
+  bool IsEnabled() const { return enabled_; }
+  // schedule of the next plan, distance in meters and clutter is the ratio
+  // of cells with cost in [0, 1]. Returns true if it's a learning plan, which
+  // runs the full schedule from initial_epsilon within max_time
+  bool ChooseSchedule(double distance, double clutter, double* initial_epsilon, double* stop_time);
+  // learn from the rounds of the last plan if it was a learning plan which
+  // reached epsilon 1, times are since search started
+  void Record(const std::vector<double>& round_end_times, const std::vector<int>& round_costs);
+  bool Save();
+
+ private:
+  bool Load();
+
+  bool enabled_;
+  double initial_epsilon_;
+  double min_time_, max_time_;
+  double target_ratio_;       // cost / cost of epsilon 1
+  std::string table_file_;
+  int num_of_levels_;
+  std::vector<EpsilonTuningBucket> buckets_;
+  int last_bucket_;           // bucket of the last learning plan, -1 if it was tuned
+  unsigned int num_of_unsaved_samples_;
+};
+
+}  // namespace search_based_global_planner
+
+#endif  // SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_EPSILON_TUNER_H_
@@ -12,23 +12,82 @@
 #ifndef SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_MOTION_PRIMITIVE_MANAGER_H_
 #define SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_MOTION_PRIMITIVE_MANAGER_H_
 
+#include <stdint.h>
 #include <vector>
+#include <string>
+#include <unordered_set>
 #include <gslib/gaussian_debug.h>
 #include "search_based_global_planner/utils.h"
 
+// bump it whenever primitives or layout of cache file change
+#define MPRIM_CACHE_VERSION 2
+#define FREE_SPACE_HEURISTIC_CACHE_VERSION 1
+// free space heuristic is searched in a box this many times of its radius,
+// so that paths leaving the table still count
+#define FREE_SPACE_HEURISTIC_SEARCH_SCALE 2
+// LONG_RANGE_FORWARD is this many times as long as LONG_FORWARD
+#define LONG_RANGE_PRIM_SCALE 3
+
 namespace search_based_global_planner {
 
 class Environment;
 
+// header of the action cache file, followed by the actions of all angles
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_of_actions;
+  uint64_t key;
+} MPrimCacheHeader;
+
+// fixed part of a cached action, followed by its arrays in the listed order
+typedef struct {
+  int32_t action_index;
+  int32_t start_theta;
+  int32_t dx;
+  int32_t dy;
+  int32_t end_theta;
+  uint32_t cost;
+  double distance;
+  uint32_t num_of_intersecting_cells;
+  uint32_t num_of_circle_center_cells;
+  uint32_t num_of_interm_pts;
+  uint32_t num_of_interm_cells_3d;
+  uint32_t num_of_interm_struct;
+  uint32_t reserved;
+} MPrimCacheAction;
+
+// header of the free space heuristic cache file, followed by the table
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t radius;
+  uint64_t key;
+} FreeSpaceHeuristicCacheHeader;
+
 class MPrimitiveManager {
  public:
   explicit MPrimitiveManager(Environment* env);
   ~MPrimitiveManager();
-  void GenerateMotionPrimitives();
+  // actions are loaded from cache_dir if they were saved there with the same
+  // parameters, otherwise they're generated and saved, empty cache_dir disables it
+  void GenerateMotionPrimitives(const std::string& cache_dir);
+  // lattice cost between states of an obstacle free map within radius cells,
+  // cached like actions, GenerateMotionPrimitives must be called first
+  void GenerateFreeSpaceHeuristic(int radius, const std::string& cache_dir);
 
  private:
   Action* CreateAction(const MotionPrimitive& mprim);
+  void AddAction(int angle_index, int mprim_index, Action* action);
   void ComputeReplanningDataForAction(Action* action);
+  void ComputeCollisionDataForAction(Action* action);
+  void AddAffectedPredCell(const XYThetaCell& cell);
+  uint64_t ComputeCacheKey();
+  bool LoadActions(const std::string& file_name, uint64_t key);
+  bool SaveActions(const std::string& file_name, uint64_t key);
+  void ComputeFreeSpaceHeuristic(int radius, std::vector<int>* table);
+  bool LoadFreeSpaceHeuristic(const std::string& file_name, uint64_t key, int radius, std::vector<int>* table);
+  bool SaveFreeSpaceHeuristic(const std::string& file_name, uint64_t key, int radius, const std::vector<int>& table);
 
  private:
   Environment* env_;
@@ -40,6 +99,8 @@ class MPrimitiveManager {
   std::vector<XYPoint> circle_center_;
 
   std::vector<MotionPrimitive> mprims_;
+  // keys of env_->affected_pred_cells_, for dedup
+  std::unordered_set<uint64_t> affected_pred_cell_keys_;
 };
 
 };  // namespace search_based_global_planner
@@ -15,12 +15,16 @@
 #include <costmap_2d/costmap_2d_ros.h>
 #include <fixpattern_path/path.h>
 #include <gslib/gaussian_debug.h>
+#include <boost/thread.hpp>
+#include <atomic>
+#include <list>
 #include <vector>
 #include <queue>
 #include <string>
 
 #include "search_based_global_planner/environment.h"
-#include "search_based_global_planner/pointer_heap.h"
+#include "search_based_global_planner/bucket_queue.h"
+#include "search_based_global_planner/epsilon_tuner.h"
 
 namespace search_based_global_planner {
 
@@ -31,6 +35,96 @@ class KeyComparator {
   }
 };
 
+class BucketKeyOf {
+ public:
+  uint32_t operator()(const EnvironmentEntry3D* entry) const {
+    return entry->key.k1;
+  }
+};
+
+// why the last plan did or didn't search from scratch
+typedef enum {
+  REPLAN_INCREMENTAL = 0,   // search of the last plan is repaired
+  REPLAN_FIRST_PLAN,
+  REPLAN_GOAL_CHANGED,
+  REPLAN_WINDOW_JUMPED,     // window moved farther than its size
+  REPLAN_TOO_MANY_CHANGES,  // more affected states than p3 or 1/10 of the window
+} ReplanReason;
+
+// one round of AD*, i.e. one ImprovePath
+typedef struct {
+  double epsilon;
+  bool found;
+  double time;
+  unsigned int num_of_expansions;
+  int cost;  // of path after the round
+} EpsilonRoundStatistics;
+
+// counters of search operations, they only increase, also in background
+typedef struct {
+  unsigned int num_of_expansions;
+  unsigned int num_of_heap_operations;
+  unsigned int num_of_states_visited;
+} SearchCounters;
+
+// statistics of the last makePlan, times are in seconds
+typedef struct {
+  // allocations of the entry pool and of buffers kept across plans, a buffer
+  // counts once per plan in which its capacity grew, 0 in steady state
+  unsigned int num_of_allocations;
+  bool found;
+  int path_cost;
+  double epsilon_satisfied;
+  ReplanReason replan_reason;
+  double total_time;
+  double import_costs_time;    // costmap to window, including long range cells
+  double costs_changed_time;
+  double heuristic_time;
+  double path_extraction_time;
+  std::vector<EpsilonRoundStatistics> rounds;  // before makePlan returns
+  unsigned int num_of_changed_cells;
+  unsigned int num_of_affected_states;   // states updated by CostsChanged
+  unsigned int num_of_expansions;
+  unsigned int num_of_heap_operations;   // push, pop, adjust, erase, one per state to rekey
+  unsigned int num_of_states_visited;    // states first visited by this plan
+  unsigned int num_of_states_generated;  // states of all tiles created since last reinitialization
+  unsigned int num_of_collision_checks;  // footprint walks of actions
+  bool cache_hit;                        // path is a cached route, nothing was searched
+  unsigned int num_of_cache_lookups;     // since initialize, hit rate is hits / lookups
+  unsigned int num_of_cache_hits;
+} SearchStatistics;
+
+// one transition of a route, action action_index from world cell x, y at heading theta
+typedef struct {
+  int x;
+  int y;
+  uint8_t theta;
+  uint8_t action_index;
+} RouteStep;
+
+// path of an earlier plan, start and goal are lattice states in world cells,
+// steps are kept to check the path against later costmaps
+typedef struct {
+  XYThetaCell start;
+  XYThetaCell goal;
+  bool broader_start_and_goal;
+  std::string map_id;
+  int cost;
+  std::vector<RouteStep> steps;
+  std::vector<XYThetaPoint> point_path;  // world frame
+  std::vector<IntermPointStruct> path_info;
+} CachedRoute;
+
+// first path found by the search instances of the portfolio, in world frame
+typedef struct {
+  bool found;
+  int cost;
+  int instance;  // portfolio_index_ of the instance which found it
+  std::vector<XYThetaPoint> point_path;
+  std::vector<IntermPointStruct> path_info;
+  std::vector<RouteStep> route;
+} PortfolioResult;
+
 class SearchBasedGlobalPlanner {
  public:
   /**
@@ -66,23 +160,110 @@ class SearchBasedGlobalPlanner {
    * @param  costmap_ros A pointer to the ROS wrapper of the costmap to use for planning
    */
   void setStaticCosmap(bool is_static);
+  /**
+   * @brief statistics of the last makePlan, published on topic statistics
+   *        if p21 is set
+   */
+  const SearchStatistics& GetSearchStatistics() const { return stats_; }
+  /**
+   * @brief Forget the routes cached by makePlan, for a map which is replaced
+   *        without changing its frame id
+   */
+  void ClearRouteCache() { route_cache_.clear(); }
+  /**
+   * @brief With background improvement, take the latest path if it's newer
+   *        than *version, never blocks
+   * @param version last version taken, updated when a newer one is taken
+   * @return True if plan and path are filled
+   */
+  bool GetImprovedPlan(unsigned int* version, std::vector<geometry_msgs::PoseStamped>* plan,
+                       fixpattern_path::Path* path);
+  /**
+   * @brief version of the path returned by the last makePlan, in portfolio
+   *        mode the slot may hold a newer one already
+   */
+  unsigned int GetLastPlanVersion() const { return last_plan_version_; }
  private:
   void RecomputeRHSVal(EnvironmentEntry3D* entry);
   void UpdateSetMembership(EnvironmentEntry3D* entry);
   void UpdateStateOfOverConsist(EnvironmentEntry3D* entry);
   void UpdateStateOfUnderConsist(EnvironmentEntry3D* entry);
+  // evaluate best action of entry if its cost is optimistic, returns false if
+  // it costs more, then rhs is recomputed and entry is put back
+  bool VerifyBestAction(EnvironmentEntry3D* entry);
   bool ComputeOrImprovePath();
+  bool ImprovePath();
   bool search(std::vector<XYThetaPoint>* point_path, std::vector<IntermPointStruct>* path_info);
   void GetEntryPath(std::vector<EnvironmentEntry3D*>* entry_path);
   void PublishPlan(const std::vector<geometry_msgs::PoseStamped>& plan);
   void GetPointPathFromEntryPath(const std::vector<EnvironmentEntry3D*>& entry_path,
                                  std::vector<XYThetaPoint>* point_path, std::vector<IntermPointStruct>* path_info);
-  void ComputeHighlightAndVelocity(const std::vector<Action>& actions_path, 
+  void ComputeHighlightAndVelocity(const std::vector<const Action*>& actions_path,
                                  std::vector<XYThetaPoint>* point_path, std::vector<IntermPointStruct>* path_info);
   void ReInitializeSearchEnvironment();
+  // start set is rebuilt every search, goal set on reinitialization
+  void UpdateStartSet();
   unsigned char TransformCostmapCost(unsigned char cost);
-  bool CostsChanged(const std::vector<XYCell>& changed_cells);
+  void SyncWindowCosts();
+  void ImportCostmap(int start_cell_x, int start_cell_y, int shift_x, int shift_y, std::vector<XYCell>* changed_cells);
+  // long_range_changed_cells are cells which start or stop offering long range primitives
+  bool CostsChanged(const std::vector<XYCell>& changed_cells, const std::vector<XYCell>& long_range_changed_cells,
+                    const std::vector<EnvironmentEntry3D*>& border_entries);
+  void ShiftWindow(int world_cell_x, int world_cell_y, int* shift_x, int* shift_y,
+                   std::vector<EnvironmentEntry3D*>* border_entries);
+  bool PlanPointPath(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                     bool broader_start_and_goal, std::vector<XYThetaPoint>* point_path,
+                     std::vector<IntermPointStruct>* path_info, int* cost);
+  void RunPortfolioMember(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal,
+                          bool broader_start_and_goal);
+  // called on instance 0 once per instance and plan, true if path is the first
+  // one of the portfolio, then it's taken to portfolio_result_
+  bool TakeFirstPath(bool found, int cost, int instance, const std::vector<XYThetaPoint>& point_path,
+                     const std::vector<IntermPointStruct>& path_info, const std::vector<RouteStep>& route);
+  // a member tells instance 0 it's done with costmap_ for this plan
+  void ReleaseCostmap();
+  // first search of instance 0 stops, another instance found a path
+  bool YieldedToPortfolio() const { return yield_to_portfolio_ && portfolio_found_; }
+  bool PlanWithPortfolio(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                         bool broader_start_and_goal, std::vector<XYThetaPoint>* point_path,
+                         std::vector<IntermPointStruct>* path_info);
+  void WindowToWorld(std::vector<XYThetaPoint>* point_path);
+  void BuildPlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                 const std::vector<XYThetaPoint>& point_path, const std::vector<IntermPointStruct>& path_info,
+                 std::vector<geometry_msgs::PoseStamped>& plan, fixpattern_path::Path& path);  // NOLINT
+  void ImproveInBackground(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal);
+  // plan of point_path goes to the slot of instance 0 if it's cheaper than
+  // the one there
+  void OfferPlan(const geometry_msgs::PoseStamped& start, const geometry_msgs::PoseStamped& goal,
+                 const std::vector<XYThetaPoint>& point_path, const std::vector<IntermPointStruct>& path_info,
+                 int cost);
+  void CancelImprovement();
+  // new version of the slot, or 0 if plan isn't cheaper than the one there,
+  // a plan taken is published
+  unsigned int StorePlan(const std::vector<geometry_msgs::PoseStamped>& plan, const fixpattern_path::Path& path,
+                         int cost);
+  void RequestReinitialization(ReplanReason reason);
+  void ResetStatistics();
+  // initial epsilon and stop time of a schedule which starts
+  void ChooseEpsilonSchedule();
+  // rounds may go on until this many seconds after search started
+  double GetTimeLimit() const { return epsilon_satisfied_ == INFINITECOST ? allocated_time_ : stop_time_; }
+  // lattice state of pose in world cells, false if it's off the costmap
+  bool GetWorldState(const geometry_msgs::PoseStamped& pose, XYThetaCell* state);
+  bool GetRouteFromEntryPath(const std::vector<EnvironmentEntry3D*>& entry_path, std::vector<RouteStep>* route);
+  // every action of route is still valid in costmap_, its footprint is swept
+  // by circle centers like in search
+  bool IsRouteFree(const std::vector<RouteStep>& route);
+  bool LookUpRouteCache(const XYThetaCell& start, const XYThetaCell& goal, bool broader_start_and_goal,
+                        std::vector<XYThetaPoint>* point_path, std::vector<IntermPointStruct>* path_info);
+  void InsertToRouteCache(const XYThetaCell& start, const XYThetaCell& goal, bool broader_start_and_goal,
+                          const std::vector<XYThetaPoint>& point_path,
+                          const std::vector<IntermPointStruct>& path_info);
+  void PublishStatistics();
   bool ReadCircleCenterFromParams(ros::NodeHandle& nh, std::vector<XYPoint>* points);
+  void ClearInconsist();
+  // buffers kept across plans which grew since last call
+  unsigned int CountBufferGrowth();
 
  private:
   costmap_2d::Costmap2DROS* costmap_ros_;
@@ -91,28 +272,117 @@ class SearchBasedGlobalPlanner {
   Environment* env_;
   EnvironmentEntry3D* start_entry_;
   EnvironmentEntry3D* goal_entry_;
-  EnvironmentEntry3D* first_met_entry_;
   double resolution_;
   bool need_to_reinitialize_environment_;
+  ReplanReason reinitialize_reason_;  // first reason since last reinitialization
   int force_scratch_limit_;
   unsigned char lethal_cost_;
+  unsigned char cost_possibly_circumscribed_thresh_;
   unsigned char inscribed_inflated_cost_;
   unsigned char cost_multiplier_;
   int map_size_;
+  // lower left cell of the window in world cells, aligned to ENTRY_TILE_SIZE
+  int window_origin_x_, window_origin_y_;
+  bool window_initialized_;
+  // TransformCostmapCost of every costmap value
+  unsigned char cost_table_[256];
+  // costs of env_ packed y major, compared with costmap row by row
+  std::vector<unsigned char> window_costs_;
+  std::vector<unsigned char> row_costs_;
+  // entries already taken by CostsChanged are stamped with affected_epoch_, by slot
+  std::vector<unsigned int> affected_stamps_;
+  unsigned int affected_epoch_;
   bool using_short_highlight_;
   unsigned int size_dir_;
 
-  // for ADStar
-  std::set<EnvironmentEntry3D*> inconsist_;
-  PointerHeap<EnvironmentEntry3D*, KeyComparator> open_;
+  // for ADStar, entries in inconsist_ are stamped with inconsist_epoch_
+  std::vector<EnvironmentEntry3D*> inconsist_;
+  unsigned int inconsist_epoch_;
+  BucketQueue<EnvironmentEntry3D*, KeyComparator, BucketKeyOf> open_;
+  // results of GetSuccs and GetPreds, kept to avoid allocation per expansion
+  std::vector<EnvironmentEntry3D*> succ_entries_buf_;
+  std::vector<int> succ_costs_buf_;
+  std::vector<Action*> succ_actions_buf_;
+  std::vector<EnvironmentEntry3D*> pred_entries_buf_;
+  std::vector<int> pred_costs_buf_;
+  std::vector<Action*> pred_actions_buf_;
+  // other buffers kept across plans
+  std::vector<EnvironmentEntry3D*> affected_entries_;
+  std::vector<EnvironmentEntry3D*> border_entries_;
+  std::vector<XYCell> changed_cells_;
+  std::vector<XYCell> long_range_changed_cells_;
+  std::vector<EnvironmentEntry3D*> entry_path_;
+  std::vector<EnvironmentEntry3D*> dropped_entries_;
+  std::vector<const Action*> actions_path_;
+  std::vector<double> sum_distance_, sum_turning_;  // along path_info of ComputeHighlightAndVelocity
+  std::vector<double> round_end_times_;
+  std::vector<int> round_costs_;
+  std::vector<XYThetaPoint> point_path_;
+  std::vector<IntermPointStruct> path_info_;
+  std::vector<fixpattern_path::PathPoint> path_points_;  // of BuildPlan
+  std::vector<size_t> buffer_capacities_;  // as of last CountBufferGrowth
+  SearchStatistics stats_;
+  SearchCounters counters_;
   unsigned int environment_iteration_, iteration_;
   double allocated_time_, start_time_;
+  // once a path is found, rounds stop at stop_time_, it's tuned by epsilon_tuner_
+  double stop_time_;
+  EpsilonTuner epsilon_tuner_;
+  bool learning_plan_;  // epsilon_tuner_ learns from rounds of this plan
+  // lazy evaluation: preds never expanded take optimistic costs of actions,
+  // which are evaluated when the pred is about to be expanded
+  bool lazy_evaluation_;
   double initial_epsilon_, eps_, epsilon_satisfied_;
   double sbpl_max_vel_, sbpl_low_vel_, sbpl_min_vel_;
   ros::Publisher plan_pub_;
+  ros::Publisher statistics_pub_;
+  bool publish_statistics_;
   bool initialized_;
   bool broader_start_and_goal_;
-  std::vector<EnvironmentEntry3D*> goal_entry_list_;
+  std::vector<EnvironmentEntry3D*> endpoint_entries_;  // buffer of start or goal set
+
+  // LRU cache of routes, most recently used first, p22 routes at most and 0
+  // to disable. A route is only cached if it was optimal when found
+  std::list<CachedRoute> route_cache_;
+  int route_cache_size_;
+  std::vector<RouteStep> route_;  // of path of last PlanPointPath, empty if it isn't optimal
+  // lower left point of window in world frame
+  double window_x_m_, window_y_m_;
+
+  // portfolio mode: more instances, each with its own environment, epsilon and
+  // motion primitives, search in parallel with this one in makePlan. makePlan
+  // returns the first path found, then all instances keep improving into the
+  // plan slot of instance 0 like background improvement
+  std::vector<SearchBasedGlobalPlanner*> portfolio_;
+  int portfolio_index_;  // 0 for the instance makePlan is called on
+  SearchBasedGlobalPlanner* portfolio_owner_;  // instance 0
+  bool full_primitive_set_;
+  // state of the plan of instance 0, under portfolio_mutex_
+  boost::mutex portfolio_mutex_;
+  boost::condition_variable portfolio_cond_;  // notified when the state changes
+  PortfolioResult portfolio_result_;
+  unsigned int portfolio_searching_;        // instances still in their first search
+  unsigned int portfolio_reading_costmap_;  // members not done with costmap_ yet
+  std::atomic<bool> portfolio_found_;       // portfolio_result_.found, to poll without the lock
+  bool yield_to_portfolio_;  // first search of instance 0 gives up once portfolio_found_
+  bool reading_costmap_;     // of a member, until ReleaseCostmap
+  // searches stop when the flag is set, members share the one of instance 0
+  std::atomic<bool> stop_search_;
+  std::atomic<bool>* stop_flag_;
+
+  // background improvement: makePlan returns the first path and this thread
+  // keeps improving it until eps is 1, time is up or makePlan is called again.
+  // each better path is published and put to the slot with a new version
+  bool background_improvement_;
+  boost::thread improve_thread_;
+  std::vector<geometry_msgs::PoseStamped> improved_plan_;
+  fixpattern_path::Path improved_path_;
+  boost::mutex plan_slot_mutex_;
+  std::vector<geometry_msgs::PoseStamped> slot_plan_;
+  fixpattern_path::Path slot_path_;
+  int slot_cost_;  // INFINITECOST until makePlan stores its path
+  std::atomic<unsigned int> plan_version_;
+  unsigned int last_plan_version_;
 };
 
 };  // namespace search_based_global_planner
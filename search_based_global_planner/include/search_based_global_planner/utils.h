@@ -14,6 +14,9 @@
 
 #include <ros/ros.h>
 #include <math.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string>
 #include <vector>
 #include <utility>
 #include <set>
@@ -35,6 +38,7 @@ typedef enum {
   SHORT_FORWARD = 0,
   NORMAL_FORWARD, 
 	LONG_FORWARD,
+	LONG_RANGE_FORWARD,  // only where there is enough clearance
 	//FORWARD_TURN_LEFT,
 	//FORWARD_TURN_RIGHT,
 	IN_PLACE_ROTATE_LEFT,
@@ -42,6 +46,8 @@ typedef enum {
 	MAX_MPRIM_INDEX
 } MprimIndex;
 
+#define ALL_MPRIM_MASK ((1u << MAX_MPRIM_INDEX) - 1)
+
 typedef struct _XYPoint {
   double x;
   double y;
@@ -130,6 +136,16 @@ typedef struct _Action {
   std::vector<XYThetaPoint> interm_pts;
   // start at 0,0,starttheta and end at endcell in discrete domain
   std::vector<XYThetaCell> interm_cells_3d;
+  // offsets of interm_cells_3d and circle_center_cells in the cell cost map of
+  // environment, bounding box of all checked cells, all relative to source cell
+  std::vector<int> interm_cell_offsets;
+  std::vector<int> circle_center_cell_offsets;
+  // squared distance in cells from the farthest circle center cell to its
+  // nearest interm cell, circle centers are safe if every interm cell is
+  // farther than that from unsafe cells
+  int circle_center_reach_sq;
+  XYCell min_cell;
+  XYCell max_cell;
   // record some useful info of intermedia points
   std::vector<IntermPointStruct> interm_struct;
 } Action;
@@ -384,6 +400,35 @@ inline double GetTimeInSeconds() {
   return t.tv_sec + 0.000001 * t.tv_usec;
 }
 
+// 1 if the index-th buffer kept across plans was reallocated since its capacity
+// was last taken into capacities, which is updated and grown on first use.
+// index is advanced to the next buffer
+inline unsigned int CountGrowth(size_t capacity, std::vector<size_t>* capacities, size_t* index) {
+  if (*index == capacities->size()) capacities->push_back(0);
+  size_t* last_capacity = &(*capacities)[(*index)++];
+  if (capacity == *last_capacity) return 0;
+  *last_capacity = capacity;
+  return 1;
+}
+
+// writes file_name with write(FILE*), which returns false on errors. writes to
+// a temporary file first and renames it, so that no one reads a partial file
+template<typename Write>
+inline bool WriteFileAtomically(const std::string& file_name, Write write) {
+  char suffix[32];
+  snprintf(suffix, sizeof(suffix), ".%d.tmp", static_cast<int>(getpid()));
+  std::string tmp_file_name = file_name + suffix;
+  FILE* file = fopen(tmp_file_name.c_str(), "wb");
+  if (!file) return false;
+  bool ok = write(file);
+  if (fclose(file) != 0) ok = false;
+  if (!ok || rename(tmp_file_name.c_str(), file_name.c_str()) != 0) {
+    unlink(tmp_file_name.c_str());
+    return false;
+  }
+  return true;
+}
+
 };  // namespace search_based_global_planner
 
 #endif  // SEARCH_BASED_GLOBAL_PLANNER_INCLUDE_SEARCH_BASED_GLOBAL_PLANNER_UTILS_H_
@@ -12,6 +12,8 @@
 #include "search_based_global_planner/environment.h"
 
 #include <ros/ros.h>
+#include <string.h>
+#include <algorithm>
 
 namespace search_based_global_planner {
 
@@ -21,7 +23,9 @@ Environment::Environment(unsigned int size_x, unsigned int size_y, double resolu
                          double timetoturn45degsinplace_secs,
                          const std::vector<XYPoint>& footprint, const std::vector<XYPoint>& circle_center,
                          int num_of_angles, int num_of_prims_per_angle, int forward_cost_mult,
-                         int forward_and_turn_cost_mult, int turn_in_place_cost_mult)
+                         int forward_and_turn_cost_mult, int turn_in_place_cost_mult,
+                         int free_space_heuristic_radius, int long_range_clearance,
+                         const std::string& mprim_cache_dir)
     : size_x_(size_x), size_y_(size_y), resolution_(resolution),
       obstacle_threshold_(obstacle_threshold), cost_inscribed_thresh_(cost_inscribed_thresh),
       cost_possibly_circumscribed_thresh_(cost_possibly_circumscribed_thresh),
@@ -29,7 +33,10 @@ Environment::Environment(unsigned int size_x, unsigned int size_y, double resolu
       footprint_(footprint), circle_center_(circle_center), num_of_angles_(num_of_angles),
       num_of_prims_per_angle_(num_of_prims_per_angle),
       forward_cost_mult_(forward_cost_mult), forward_and_turn_cost_mult_(forward_and_turn_cost_mult),
-      turn_in_place_cost_mult_(turn_in_place_cost_mult) {
+      turn_in_place_cost_mult_(turn_in_place_cost_mult),
+      free_space_heuristic_radius_(free_space_heuristic_radius), use_free_space_heuristic_(true),
+      start_free_space_heuristic_(NULL), turn_costs_start_theta_(-1),
+      long_range_clearance_(long_range_clearance), need_to_update_long_range_cells_(true) {
   size_dir_ = num_of_angles_;
 
   mprim_manager_ = new MPrimitiveManager(this);
@@ -37,6 +44,8 @@ Environment::Environment(unsigned int size_x, unsigned int size_y, double resolu
   // for computing heuristic
   iteration_ = 0;
   largest_computed_heuristic_ = 0;
+  need_to_update_heuristics_ = true;
+  need_to_recompute_heuristics_ = true;
   // compute some constance for computing heuristic
   ComputeDXY();
 
@@ -50,30 +59,78 @@ Environment::Environment(unsigned int size_x, unsigned int size_y, double resolu
       grid_[i][j].y = j;
       grid_[i][j].heap_index = -1;
       grid_[i][j].heuristic = INFINITECOST;
+      grid_[i][j].rhs = INFINITECOST;
+      grid_[i][j].cost = 0;
     }
   }
-
-  // create environment entry
-  env_ = new EnvironmentEntry3D**[size_x_];
-  for (unsigned int i = 0; i < size_x_; ++i) {
-    env_[i] = new EnvironmentEntry3D*[size_y_];
-    for (unsigned int j = 0; j < size_y_; ++j) {
-      env_[i][j] = new EnvironmentEntry3D[size_dir_];
-      for (unsigned int k = 0; k < size_dir_; ++k) {
-        env_[i][j][k].x = i;
-        env_[i][j][k].y = j;
-        env_[i][j][k].theta = k;
-        env_[i][j][k].g = INFINITECOST;
-        env_[i][j][k].rhs = INFINITECOST;
-        env_[i][j][k].best_next_entry = NULL;
-        env_[i][j][k].heap_index = -1;
-        env_[i][j][k].visited_iteration = -1;
-        env_[i][j][k].closed_iteration = -1;
-      }
+  cell_costs_ = new unsigned char[size_x_ * size_y_];
+  memset(cell_costs_, CellCostOf(0), size_x_ * size_y_);
+  long_range_cells_.assign(size_x_ * size_y_, 0);
+
+  // create hash of environment entry, entries themselves are created lazily
+  angle_bits_ = 0;
+  while ((1 << angle_bits_) < num_of_angles_) ++angle_bits_;
+  tile_entry_shift_ = 2 * ENTRY_TILE_SHIFT + angle_bits_;
+  size_tile_x_ = (size_x_ + ENTRY_TILE_MASK) >> ENTRY_TILE_SHIFT;
+  num_of_allocations_ = 0;
+  num_of_collision_checks_ = 0;
+  last_tile_id_ = UINT32_MAX;
+  last_tile_ = NULL;
+  epoch_ = 1;
+  hash_mask_ = INITIAL_ENTRY_HASH_SIZE - 1;
+  hash_shift_ = 32 - INITIAL_ENTRY_HASH_BITS;
+  hash_ = new EntryHashBucket[INITIAL_ENTRY_HASH_SIZE];
+  memset(hash_, 0, INITIAL_ENTRY_HASH_SIZE * sizeof(EntryHashBucket));
+  // tile 0 of the pool is never hashed, it holds the virtual states
+  entry_tiles_.push_back(new EnvironmentEntry3D[1 << tile_entry_shift_]);
+  cold_tiles_.push_back(new EnvironmentEntry3DCold[1 << tile_entry_shift_]);
+  num_of_tiles_ = 1;
+  super_start_ = &entry_tiles_[0][0];
+  super_goal_ = &entry_tiles_[0][1];
+  ResetVirtualEntries();
+
+  mprim_manager_->GenerateMotionPrimitives(mprim_cache_dir);
+  SetPrimitiveMask(ALL_MPRIM_MASK);
+  long_range_goal_distance_sq_ = 0;
+  for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+    const Action* action = actions_[angle_index][LONG_RANGE_FORWARD];
+    long_range_goal_distance_sq_ = std::max(long_range_goal_distance_sq_,
+                                            action->dx * action->dx + action->dy * action->dy);
+  }
+  // from all primitives, so that it's a lower bound for any primitive mask
+  mprim_manager_->GenerateFreeSpaceHeuristic(free_space_heuristic_radius_, mprim_cache_dir);
+  if (!free_space_heuristic_.empty()) ComputeHeadingCones();
+
+  // clearance only needs to tell if a cell is farther than any reach, so it
+  // saturates above the largest one of circle centers and footprints
+  int max_reach_sq = 0;
+  for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+    for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+      max_reach_sq = std::max(max_reach_sq, actions_[angle_index][mprim_index]->circle_center_reach_sq);
     }
+    std::set<XYCell> footprint_cells;
+    XYThetaPoint pose(DISCXY2CONT(0, resolution_), DISCXY2CONT(0, resolution_),
+                      DiscTheta2Cont(angle_index, num_of_angles_));
+    Get2DFootprintCells(footprint_, &footprint_cells, pose, resolution_);
+    int reach_sq = 0;
+    for (const auto& cell : footprint_cells) reach_sq = std::max(reach_sq, cell.x * cell.x + cell.y * cell.y);
+    footprint_reach_sq_.push_back(reach_sq);
+    max_reach_sq = std::max(max_reach_sq, reach_sq);
   }
-
-  mprim_manager_->GenerateMotionPrimitives();
+  clearance_cap_sq_ = std::min(max_reach_sq + 1, static_cast<int>(UINT16_MAX));
+  int reach = static_cast<int>(sqrt(clearance_cap_sq_));
+  for (int dx = -reach; dx <= reach; ++dx) {
+    for (int dy = -reach; dy <= reach; ++dy) {
+      if (dx * dx + dy * dy < clearance_cap_sq_) clearance_offsets_.push_back(XYCell(dx, dy));
+    }
+  }
+  std::sort(clearance_offsets_.begin(), clearance_offsets_.end(), [](const XYCell& a, const XYCell& b) {
+    return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+  });
+  // no cell is unsafe yet
+  clearance_sq_.assign(size_x_ * size_y_, clearance_cap_sq_);
+  clearance_dirty_.assign(size_x_ * size_y_, 0);
+  need_to_recompute_clearance_ = false;
 }
 
 void Environment::ComputeDXY() {
@@ -148,60 +205,258 @@ void Environment::ComputeDXY() {
 Environment::~Environment() {
   delete mprim_manager_;
 
-  // delete actions
+  // delete actions, succ_actions_ and pred_actions_ point to the same ones
   for (unsigned int i = 0; i < num_of_angles_; ++i) {
     for (unsigned int j = 0; j < num_of_prims_per_angle_; ++j) {
       delete actions_[i][j];
-      delete pred_actions_[i][j];
-      actions_[i][j] = pred_actions_[i][j] = NULL;
+      actions_[i][j] = NULL;
     }
   }
 
   // delete environment
-  for (unsigned int i = 0; i < size_x_; ++i) {
-    for (unsigned int j = 0; j < size_y_; ++j) {
-      delete[] env_[i][j];
-    }
-    delete env_[i];
+  for (unsigned int i = 0; i < entry_tiles_.size(); ++i) {
+    delete[] entry_tiles_[i];
+    delete[] cold_tiles_[i];
   }
-  delete env_;
+  delete[] hash_;
 
   // delete grid_
   for (unsigned int i = 0; i < size_x_; ++i) {
      delete[] grid_[i];
   }
-  delete grid_;
+  delete[] grid_;
+  delete[] cell_costs_;
 }
 
 void Environment::ReInitialize() {
-  // heuristic reinitialize
-  iteration_ = 0;
-  largest_computed_heuristic_ = 0;
+  // heuristic reinitialize, entries of grid_ are stamped with iteration_, so
+  // ComputeHeuristicValues will overwrite them before they're used
   need_to_update_heuristics_ = true;
-  for (unsigned int i = 0; i < size_x_; ++i) {
-    for (unsigned int j = 0; j < size_y_; ++j) {
-      grid_[i][j].visited_iteration = -1;
-      grid_[i][j].heap_index = -1;
-      grid_[i][j].heuristic = INFINITECOST;
+
+  // env_ reinitialize: forget all tiles generated so far, pool is reused
+  num_of_tiles_ = 1;
+  free_tiles_.clear();
+  ResetVirtualEntries();
+  start_set_.clear();
+  goal_set_.clear();
+  last_tile_id_ = UINT32_MAX;
+  if (++epoch_ == 0) {
+    memset(hash_, 0, (hash_mask_ + 1) * sizeof(EntryHashBucket));
+    epoch_ = 1;
+  }
+}
+
+EntryHashBucket* Environment::CreateTile(EntryHashBucket* bucket, unsigned int id) {
+  // keep load factor under 0.5
+  if (2 * (num_of_tiles_ + 1) > hash_mask_ + 1) {
+    GrowHashTable();
+    bucket = FindBucket(id);
+  }
+
+  unsigned int tile;
+  if (!free_tiles_.empty()) {
+    tile = free_tiles_.back();
+    free_tiles_.pop_back();
+  } else {
+    tile = num_of_tiles_++;
+    if (tile >= entry_tiles_.size()) {
+      entry_tiles_.push_back(new EnvironmentEntry3D[1 << tile_entry_shift_]);
+      cold_tiles_.push_back(new EnvironmentEntry3DCold[1 << tile_entry_shift_]);
+      num_of_allocations_ += 2;
     }
   }
 
-  // env_ reinitialize
-  for (unsigned int i = 0; i < size_x_; ++i) {
-    for (unsigned int j = 0; j < size_y_; ++j) {
-      for (unsigned int k = 0; k < size_dir_; ++k) {
-        env_[i][j][k].g = INFINITECOST;
-        env_[i][j][k].rhs = INFINITECOST;
-        env_[i][j][k].best_next_entry = NULL;
-        env_[i][j][k].heap_index = -1;
-        env_[i][j][k].visited_iteration = -1;
-        env_[i][j][k].closed_iteration = -1;
+  bucket->id = id;
+  bucket->tile = tile;
+  bucket->epoch = epoch_;
+
+  int origin_x = (id % size_tile_x_) << ENTRY_TILE_SHIFT;
+  int origin_y = (id / size_tile_x_) << ENTRY_TILE_SHIFT;
+  for (int y = origin_y; y < origin_y + ENTRY_TILE_SIZE; ++y) {
+    for (int x = origin_x; x < origin_x + ENTRY_TILE_SIZE; ++x) {
+      for (int theta = 0; theta < num_of_angles_; ++theta) {
+        unsigned int local = LocalIndex(x, y, theta);
+        EnvironmentEntry3D* entry = &entry_tiles_[tile][local];
+        entry->x = x;
+        entry->y = y;
+        entry->theta = theta;
+        entry->slot = (tile << tile_entry_shift_) + local;
+        entry->endpoint = 0;
+        entry->g = INFINITECOST;
+        entry->rhs = INFINITECOST;
+        entry->heap_index = -1;
+
+        EnvironmentEntry3DCold* cold = &cold_tiles_[tile][local];
+        cold->best_next_entry = NULL;
+        cold->best_action = NULL;
+        cold->visited_iteration = -1;
+        cold->closed_iteration = -1;
+        cold->inconsist_epoch = 0;
+        cold->unverified = false;
       }
     }
   }
+
+  return bucket;
+}
+
+void Environment::ResetVirtualEntries() {
+  EnvironmentEntry3D* entries[] = {super_start_, super_goal_};
+  for (EnvironmentEntry3D* entry : entries) {
+    entry->x = entry->y = -1;
+    entry->theta = 0;
+    entry->endpoint = 0;
+    entry->slot = entry - entry_tiles_[0];
+    entry->g = INFINITECOST;
+    entry->rhs = INFINITECOST;
+    entry->heap_index = -1;
+
+    EnvironmentEntry3DCold* cold = GetColdEntry(entry);
+    cold->best_next_entry = NULL;
+    cold->best_action = NULL;
+    cold->visited_iteration = -1;
+    cold->closed_iteration = -1;
+    cold->inconsist_epoch = 0;
+    cold->unverified = false;
+  }
+}
+
+void Environment::SetEndpointSet(const std::vector<EnvironmentEntry3D*>& entries, uint8_t bit,
+                                 std::vector<EnvironmentEntry3D*>* set) {
+  // entries of the old set may have been dropped, their tiles reset the bits when reused
+  for (const auto& entry : *set) entry->endpoint &= ~bit;
+  set->assign(entries.begin(), entries.end());
+  for (const auto& entry : *set) entry->endpoint |= bit;
+}
+
+bool Environment::SetStartSet(const std::vector<EnvironmentEntry3D*>& entries) {
+  bool changed = entries != start_set_;
+  SetEndpointSet(entries, ENDPOINT_START_SET, &start_set_);
+  return changed;
+}
+
+void Environment::SetGoalSet(const std::vector<EnvironmentEntry3D*>& entries) {
+  SetEndpointSet(entries, ENDPOINT_GOAL_SET, &goal_set_);
+}
+
+unsigned int Environment::GetNumOfAllocations() {
+  size_t index = 0;
+  num_of_allocations_ += CountGrowth(free_tiles_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(kept_tiles_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(start_set_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(goal_set_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(heuristic_changed_cells_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(grid_open_.vector().capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(clearance_changed_cells_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(clearance_dirty_cells_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(clearance_column_sq_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(envelope_sites_.capacity(), &buffer_capacities_, &index);
+  num_of_allocations_ += CountGrowth(envelope_bounds_.capacity(), &buffer_capacities_, &index);
+  return num_of_allocations_;
+}
+
+void Environment::GrowHashTable() {
+  unsigned int old_size = hash_mask_ + 1;
+  EntryHashBucket* old_hash = hash_;
+
+  hash_mask_ = 2 * old_size - 1;
+  hash_shift_--;
+  hash_ = new EntryHashBucket[2 * old_size];
+  num_of_allocations_++;
+  memset(hash_, 0, 2 * old_size * sizeof(EntryHashBucket));
+
+  for (unsigned int i = 0; i < old_size; ++i) {
+    if (old_hash[i].epoch != epoch_) continue;
+    *FindBucket(old_hash[i].id) = old_hash[i];
+  }
+  delete[] old_hash;
+}
+
+void Environment::ShiftWindow(int dx, int dy, std::vector<EnvironmentEntry3D*>* dropped_entries,
+                              std::vector<EnvironmentEntry3D*>* border_entries) {
+  // costs, walk in the direction that reads cells before they're overwritten
+  for (int i = 0; i < size_x_; ++i) {
+    int x = dx >= 0 ? i : size_x_ - 1 - i;
+    for (int j = 0; j < size_y_; ++j) {
+      int y = dy >= 0 ? j : size_y_ - 1 - j;
+      unsigned char cost = GetCost(x + dx, y + dy);
+      grid_[x][y].cost = cost;
+      cell_costs_[x * size_y_ + y] = CellCostOf(cost);
+      long_range_cells_[x * size_y_ + y] =
+          IsWithinMapCell(x + dx, y + dy) ? long_range_cells_[(x + dx) * size_y_ + y + dy] : 0;
+    }
+  }
+  need_to_update_long_range_cells_ = true;
+  clearance_changed_cells_.clear();
+  need_to_recompute_clearance_ = true;
+  heuristic_changed_cells_.clear();
+  need_to_recompute_heuristics_ = true;
+  need_to_update_heuristics_ = true;
+
+  // cells kept by the move in new coordinates, actions of entries within
+  // reach of its moved sides could go through exposed or dropped cells
+  int kept_min_x = std::max(0, -dx), kept_max_x = std::min<int>(size_x_, size_x_ - dx) - 1;
+  int kept_min_y = std::max(0, -dy), kept_max_y = std::min<int>(size_y_, size_y_ - dy) - 1;
+  int reach = 0;
+  for (const auto& cell : affected_pred_cells_) {
+    reach = std::max(reach, std::max(abs(cell.x), abs(cell.y)));
+  }
+
+  // tiles are moved as a whole, rebuild the hash with their new ids
+  int size_tile_y = (size_y_ + ENTRY_TILE_MASK) >> ENTRY_TILE_SHIFT;
+  kept_tiles_.clear();
+  for (unsigned int i = 0; i <= hash_mask_; ++i) {
+    if (hash_[i].epoch != epoch_) continue;
+    unsigned int tile = hash_[i].tile;
+    int tile_x = static_cast<int>(hash_[i].id % size_tile_x_) - (dx >> ENTRY_TILE_SHIFT);
+    int tile_y = static_cast<int>(hash_[i].id / size_tile_x_) - (dy >> ENTRY_TILE_SHIFT);
+    EnvironmentEntry3D* entries = entry_tiles_[tile];
+    if (tile_x < 0 || tile_y < 0 || tile_x >= size_tile_x_ || tile_y >= size_tile_y) {
+      free_tiles_.push_back(tile);
+      if (dropped_entries == NULL) continue;
+      for (unsigned int j = 0; j < (1u << tile_entry_shift_); ++j) dropped_entries->push_back(&entries[j]);
+      continue;
+    }
+
+    EntryHashBucket bucket;
+    bucket.id = tile_x + tile_y * size_tile_x_;
+    bucket.tile = tile;
+    kept_tiles_.push_back(bucket);
+    for (unsigned int j = 0; j < (1u << tile_entry_shift_); ++j) {
+      entries[j].x -= dx;
+      entries[j].y -= dy;
+    }
+
+    if (border_entries == NULL) continue;
+    int min_x = tile_x << ENTRY_TILE_SHIFT, max_x = min_x + ENTRY_TILE_MASK;
+    int min_y = tile_y << ENTRY_TILE_SHIFT, max_y = min_y + ENTRY_TILE_MASK;
+    if ((dx != 0 && (min_x - kept_min_x < reach || kept_max_x - max_x < reach)) ||
+        (dy != 0 && (min_y - kept_min_y < reach || kept_max_y - max_y < reach))) {
+      for (unsigned int j = 0; j < (1u << tile_entry_shift_); ++j) border_entries->push_back(&entries[j]);
+    }
+  }
+
+  if (++epoch_ == 0) {
+    memset(hash_, 0, (hash_mask_ + 1) * sizeof(EntryHashBucket));
+    epoch_ = 1;
+  }
+  for (auto& bucket : kept_tiles_) {
+    bucket.epoch = epoch_;
+    *FindBucket(bucket.id) = bucket;
+  }
+  last_tile_id_ = UINT32_MAX;
 }
 
 bool Environment::IsValidConfiguration(int cell_x, int cell_y, int theta) {
+  // footprint within window and farther from unsafe cells than its reach
+  // can't have an invalid cell
+  int reach = static_cast<int>(sqrt(footprint_reach_sq_[theta])) + 1;
+  if (!need_to_recompute_clearance_ && clearance_changed_cells_.empty() &&
+      IsWithinMapCell(cell_x - reach, cell_y - reach) && IsWithinMapCell(cell_x + reach, cell_y + reach) &&
+      clearance_sq_[cell_x * size_y_ + cell_y] > footprint_reach_sq_[theta]) {
+    return true;
+  }
+
   std::set<XYCell> footprint_points;
   XYThetaPoint pose;
 
@@ -244,7 +499,7 @@ EnvironmentEntry3D* Environment::SetGoal(double x_m, double y_m, double theta_ra
   goal_cell_.y = y;
   goal_cell_.theta = theta;
 
-  return &env_[x][y][theta];
+  return GetEnvEntry(x, y, theta);
 }
 
 EnvironmentEntry3D* Environment::SetStart(double x_m, double y_m, double theta_rad) {
@@ -261,9 +516,11 @@ EnvironmentEntry3D* Environment::SetStart(double x_m, double y_m, double theta_r
     GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] start configuration %d %d %d is invalid", x, y, theta);
   }
 
-  // we're using backward search, once start changes, heuristics must be updated
-  if (x != start_cell_.x || y != start_cell_.y || theta != start_cell_.theta) {
+  // we're using backward search, once start changes, heuristics must be
+  // computed from scratch since the 2D search is rooted at start cell
+  if (x != start_cell_.x || y != start_cell_.y) {
     need_to_update_heuristics_ = true;
+    need_to_recompute_heuristics_ = true;
   }
 
   // set start_cell_
@@ -271,15 +528,170 @@ EnvironmentEntry3D* Environment::SetStart(double x_m, double y_m, double theta_r
   start_cell_.y = y;
   start_cell_.theta = theta;
 
-  return &env_[x][y][theta];
+  int width = 2 * free_space_heuristic_radius_ + 1;
+  start_free_space_heuristic_ = (use_free_space_heuristic_ && !free_space_heuristic_.empty()) ?
+      &free_space_heuristic_[theta * width * width * num_of_angles_] : NULL;
+  if (start_free_space_heuristic_ != NULL && theta != turn_costs_start_theta_) ComputeStartTurnCosts(theta);
+
+  return GetEnvEntry(x, y, theta);
 }
 
 void Environment::UpdateCost(unsigned int x, unsigned int y, unsigned char cost) {
+  if (grid_[x][y].cost == cost) return;
+  if ((grid_[x][y].cost == 0) != (cost == 0)) need_to_update_long_range_cells_ = true;
   grid_[x][y].cost = cost;
-
+  unsigned char& cell_cost = cell_costs_[x * size_y_ + y];
+  if ((cell_cost == CELL_COST_UNSAFE) != (CellCostOf(cost) == CELL_COST_UNSAFE) && !need_to_recompute_clearance_) {
+    clearance_changed_cells_.push_back(XYCell(x, y));
+    if (clearance_changed_cells_.size() > size_x_ * size_y_ / MAX_CLEARANCE_REPAIR_CELLS_DIVISOR) {
+      clearance_changed_cells_.clear();
+      need_to_recompute_clearance_ = true;
+    }
+  }
+  cell_cost = CellCostOf(cost);
+
+  // repairing the 2D search only pays off for local changes, e.g. sensor
+  // updates, when window moves most cells change, so compute it from scratch
+  if (!need_to_recompute_heuristics_) {
+    heuristic_changed_cells_.push_back(XYCell(x, y));
+    if (heuristic_changed_cells_.size() > size_x_ * size_y_ / MAX_HEURISTIC_REPAIR_CELLS_DIVISOR) {
+      heuristic_changed_cells_.clear();
+      need_to_recompute_heuristics_ = true;
+    }
+  }
   need_to_update_heuristics_ = true;
 }
 
+void Environment::UpdateLongRangeCells(std::vector<XYCell>* changed_cells) {
+  if (!need_to_update_long_range_cells_) return;
+  need_to_update_long_range_cells_ = false;
+
+  // sums[(x + 1) * stride + y + 1] is number of cells with cost > 0 in [0, x] x [0, y]
+  int stride = size_y_ + 1;
+  cost_cell_sums_.resize((size_x_ + 1) * stride, 0);
+  int* sums = &cost_cell_sums_[0];
+  for (int x = 0; x < size_x_; ++x) {
+    const unsigned char* costs = &cell_costs_[x * size_y_];
+    int* column = &sums[(x + 1) * stride + 1];
+    int* prev_column = &sums[x * stride + 1];
+    for (int y = 0; y < size_y_; ++y) {
+      column[y] = (costs[y] != 0) + column[y - 1] + prev_column[y] - prev_column[y - 1];
+    }
+  }
+  if (long_range_clearance_ < 0) return;
+
+  // cells out of window count as cost > 0
+  int r = long_range_clearance_;
+  for (int x = 0; x < size_x_; ++x) {
+    for (int y = 0; y < size_y_; ++y) {
+      uint8_t open = x >= r && y >= r && x + r < size_x_ && y + r < size_y_ &&
+                     sums[(x + r + 1) * stride + y + r + 1] - sums[(x - r) * stride + y + r + 1] -
+                     sums[(x + r + 1) * stride + y - r] + sums[(x - r) * stride + y - r] == 0;
+      uint8_t& cell = long_range_cells_[x * size_y_ + y];
+      if (cell == open) continue;
+      cell = open;
+      if (changed_cells != NULL) changed_cells->push_back(XYCell(x, y));
+    }
+  }
+}
+
+void Environment::UpdateClearance() {
+  if (need_to_recompute_clearance_) {
+    ComputeClearance();
+  } else if (!clearance_changed_cells_.empty()) {
+    RepairClearance();
+  }
+  need_to_recompute_clearance_ = false;
+  clearance_changed_cells_.clear();
+}
+
+void Environment::ComputeClearance() {
+  // exact euclidean distance transform of Felzenszwalb and Huttenlocher,
+  // nearest unsafe cell along y first, then lower envelope of parabolas along x
+  const int inf = INFINITECOST;
+  clearance_column_sq_.resize(size_x_ * size_y_);
+  int* column_sq = &clearance_column_sq_[0];
+  for (int x = 0; x < size_x_; ++x) {
+    const unsigned char* costs = &cell_costs_[x * size_y_];
+    int* column = &column_sq[x * size_y_];
+    int last = -inf;
+    for (int y = 0; y < size_y_; ++y) {
+      if (costs[y] == CELL_COST_UNSAFE) last = y;
+      column[y] = last == -inf ? inf : y - last;
+    }
+    last = inf;
+    for (int y = size_y_ - 1; y >= 0; --y) {
+      if (costs[y] == CELL_COST_UNSAFE) last = y;
+      if (last != inf) column[y] = std::min(column[y], last - y);
+      if (column[y] != inf) column[y] *= column[y];
+    }
+  }
+
+  envelope_sites_.resize(size_x_);
+  envelope_bounds_.resize(size_x_ + 1);
+  int* sites = &envelope_sites_[0];
+  double* bounds = &envelope_bounds_[0];
+  for (int y = 0; y < size_y_; ++y) {
+    // parabolas of cells with an unsafe cell in their column
+    int k = -1;
+    for (int x = 0; x < size_x_; ++x) {
+      int f = column_sq[x * size_y_ + y];
+      if (f == inf) continue;
+      double s = -HUGE_VAL;
+      while (k >= 0) {
+        int v = sites[k];
+        s = ((f + x * x) - (column_sq[v * size_y_ + y] + v * v)) / (2.0 * (x - v));
+        if (s > bounds[k]) break;
+        --k;
+      }
+      ++k;
+      sites[k] = x;
+      bounds[k] = k == 0 ? -HUGE_VAL : s;
+    }
+
+    int j = 0;
+    for (int x = 0; x < size_x_; ++x) {
+      int d = clearance_cap_sq_;
+      if (k >= 0) {
+        while (j < k && bounds[j + 1] < x) ++j;
+        int v = sites[j];
+        d = std::min(d, (x - v) * (x - v) + column_sq[v * size_y_ + y]);
+      }
+      clearance_sq_[x * size_y_ + y] = d;
+    }
+  }
+}
+
+void Environment::RepairClearance() {
+  // only cells closer than cap to a changed cell could change
+  int reach = static_cast<int>(sqrt(clearance_cap_sq_ - 1));
+  clearance_dirty_cells_.clear();
+  for (const auto& cell : clearance_changed_cells_) {
+    for (int x = std::max(0, cell.x - reach); x <= std::min<int>(size_x_ - 1, cell.x + reach); ++x) {
+      for (int y = std::max(0, cell.y - reach); y <= std::min<int>(size_y_ - 1, cell.y + reach); ++y) {
+        int index = x * size_y_ + y;
+        if (clearance_dirty_[index]) continue;
+        clearance_dirty_[index] = 1;
+        clearance_dirty_cells_.push_back(index);
+      }
+    }
+  }
+
+  // nearest unsafe cell of each, offsets go from near to far
+  for (const auto& index : clearance_dirty_cells_) {
+    clearance_dirty_[index] = 0;
+    int x = index / size_y_, y = index % size_y_;
+    int d = clearance_cap_sq_;
+    for (const auto& offset : clearance_offsets_) {
+      int cell_x = x + offset.x, cell_y = y + offset.y;
+      if (!IsWithinMapCell(cell_x, cell_y) || cell_costs_[cell_x * size_y_ + cell_y] != CELL_COST_UNSAFE) continue;
+      d = offset.x * offset.x + offset.y * offset.y;
+      break;
+    }
+    clearance_sq_[index] = d;
+  }
+}
+
 void Environment::EnsureHeuristicsUpdated() {
   if (need_to_update_heuristics_) {
     ComputeHeuristicValues();
@@ -287,80 +699,122 @@ void Environment::EnsureHeuristicsUpdated() {
   }
 }
 
-bool Environment::ComputeHeuristicValues() {
-  EnvironmentEntry2D* search_exp_space_ = NULL;
-  EnvironmentEntry2D* search_pred_space_ = NULL;
+int Environment::GetHeuristicEdgeCost(int x, int y, int dir) {
+  int new_x = x + heuristic_dx_[dir];
+  int new_y = y + heuristic_dy_[dir];
+  if (!IsWithinMapCell(new_x, new_y)) return INFINITECOST;
+
+  // compute the cost
+  unsigned char map_cost = std::max(grid_[new_x][new_y].cost, grid_[x][y].cost);
 
-  // closed = 0
-  iteration_++;
+  if (dir > 7) {
+    // check two more cells through which the action goes
+    map_cost = std::max(map_cost, grid_[x + heuristic_dx0_intersects_[dir]][y + heuristic_dy0_intersects_[dir]].cost);
+    map_cost = std::max(map_cost, grid_[x + heuristic_dx1_intersects_[dir]][y + heuristic_dy1_intersects_[dir]].cost);
+  }
+
+  if (map_cost >= obstacle_threshold_)  // obstacle encountered
+    return INFINITECOST;
+  return (map_cost + 1) * heuristic_dxy_distance_mm_[dir];
+}
 
-  // clear the heap
-  grid_open_.clear();
+void Environment::RecomputeHeuristicRHS(EnvironmentEntry2D* entry) {
+  if (entry->x == start_cell_.x && entry->y == start_cell_.y) return;
 
-  // initialize the start and goal states
-  search_exp_space_ = &grid_[start_cell_.x][start_cell_.y];
-  EnvironmentEntry2D* search_goal_space = &grid_[goal_cell_.x][goal_cell_.y];
-  search_exp_space_->heuristic = search_goal_space->heuristic = INFINITECOST;
-  search_exp_space_->visited_iteration = search_goal_space->visited_iteration = iteration_;
+  // edges are symmetric, so rhs is the best over all neighbors
+  entry->rhs = INFINITECOST;
+  for (int dir = 0; dir < NUM_OF_HEURISTIC_SEARCH_DIR; dir++) {
+    int cost = GetHeuristicEdgeCost(entry->x, entry->y, dir);
+    if (cost >= INFINITECOST) continue;
+    EnvironmentEntry2D* neighbor = GetHeuristicEntry(entry->x + heuristic_dx_[dir], entry->y + heuristic_dy_[dir]);
+    if (neighbor->heuristic >= INFINITECOST) continue;
+    entry->rhs = std::min(entry->rhs, std::min(INFINITECOST, cost + neighbor->heuristic));
+  }
+}
 
-  // seed the search
-  search_exp_space_->heuristic = 0;
+void Environment::UpdateHeuristicEntry(EnvironmentEntry2D* entry) {
+  bool in_open = PTRHEAP_OK == grid_open_.contain(entry);
+  if (entry->heuristic != entry->rhs) {
+    entry->key = std::min(entry->heuristic, entry->rhs);
+    if (in_open)
+      grid_open_.adjust(entry);
+    else
+      grid_open_.push(entry);
+  } else if (in_open) {
+    grid_open_.erase(entry);
+  }
+}
 
-  grid_open_.push(search_exp_space_);
+bool Environment::ComputeHeuristicValues() {
+  if (need_to_recompute_heuristics_) {
+    // closed = 0
+    iteration_++;
+
+    // clear the heap
+    grid_open_.clear();
+
+    // seed the search
+    EnvironmentEntry2D* start_entry = GetHeuristicEntry(start_cell_.x, start_cell_.y);
+    start_entry->rhs = 0;
+    UpdateHeuristicEntry(start_entry);
+
+    heuristic_changed_cells_.clear();
+    need_to_recompute_heuristics_ = false;
+  } else {
+    // a changed cell affects every edge within 2 cells of it
+    for (const auto& cell : heuristic_changed_cells_) {
+      for (int x = cell.x - 2; x <= cell.x + 2; ++x) {
+        for (int y = cell.y - 2; y <= cell.y + 2; ++y) {
+          if (!IsWithinMapCell(x, y)) continue;
+          EnvironmentEntry2D* entry = GetHeuristicEntry(x, y);
+          RecomputeHeuristicRHS(entry);
+          UpdateHeuristicEntry(entry);
+        }
+      }
+    }
+    heuristic_changed_cells_.clear();
+  }
 
   // set the termination condition
   const float term_factor = 0.5;
 
-  char *grid_closed = (char*)calloc(1, size_x_ * size_y_);  // NOLINT
-
   // the main repetition of expansions
-  search_exp_space_ = grid_open_.top();
+  EnvironmentEntry2D* search_goal_space = GetHeuristicEntry(goal_cell_.x, goal_cell_.y);
+  EnvironmentEntry2D* search_exp_space_ = grid_open_.top();
   while (!grid_open_.empty() &&
-         std::min(INFINITECOST, search_goal_space->heuristic) > term_factor * search_exp_space_->heuristic) {
+         (search_goal_space->heuristic != search_goal_space->rhs ||
+          std::min(INFINITECOST, search_goal_space->heuristic) > term_factor * search_exp_space_->key)) {
     grid_open_.pop();
 
     int exp_x = search_exp_space_->x;
     int exp_y = search_exp_space_->y;
 
-    // close the state
-    grid_closed[exp_x + size_x_ * exp_y] = 1;
-
-    // iterate over successors
-    unsigned char exp_cost = grid_[exp_x][exp_y].cost;
-    for (int dir = 0; dir < NUM_OF_HEURISTIC_SEARCH_DIR; dir++) {
-      int new_x = exp_x + heuristic_dx_[dir];
-      int new_y = exp_y + heuristic_dy_[dir];
-
-      // make sure it is inside the map and has no obstacle
-      if (!IsWithinMapCell(new_x, new_y)) continue;
-
-      if (grid_closed[new_x + size_x_ * new_y] == 1) continue;
-
-      // compute the cost
-      unsigned char map_cost = std::max(grid_[new_x][new_y].cost, exp_cost);
-
-      if (dir > 7) {
-        // check two more cells through which the action goes
-        map_cost = std::max(map_cost, grid_[exp_x + heuristic_dx0_intersects_[dir]][exp_y + heuristic_dy0_intersects_[dir]].cost);
-        map_cost = std::max(map_cost, grid_[exp_x + heuristic_dx1_intersects_[dir]][exp_y + heuristic_dy1_intersects_[dir]].cost);
+    if (search_exp_space_->heuristic > search_exp_space_->rhs) {
+      // overconsistent, close the state and relax its neighbors
+      search_exp_space_->heuristic = search_exp_space_->rhs;
+      for (int dir = 0; dir < NUM_OF_HEURISTIC_SEARCH_DIR; dir++) {
+        int cost = GetHeuristicEdgeCost(exp_x, exp_y, dir);
+        if (cost >= INFINITECOST) continue;
+
+        // update neighbor if necessary
+        EnvironmentEntry2D* search_pred_space_ = GetHeuristicEntry(exp_x + heuristic_dx_[dir], exp_y + heuristic_dy_[dir]);
+        if (search_pred_space_->rhs > cost + search_exp_space_->heuristic) {
+          search_pred_space_->rhs = std::min(INFINITECOST, cost + search_exp_space_->heuristic);
+          UpdateHeuristicEntry(search_pred_space_);
+        }
       }
-
-      if (map_cost >= obstacle_threshold_)  // obstacle encountered
-        continue;
-      int cost = (map_cost + 1) * heuristic_dxy_distance_mm_[dir];
-
-      // get the predecessor
-      search_pred_space_ = &grid_[new_x][new_y];
-
-      // update predecessor if necessary
-      if (search_pred_space_->visited_iteration != iteration_ || search_pred_space_->heuristic > cost + search_exp_space_->heuristic) {
-        search_pred_space_->visited_iteration = iteration_;
-        search_pred_space_->heuristic = std::min(INFINITECOST, cost + search_exp_space_->heuristic);
-
-        if (PTRHEAP_OK != grid_open_.contain(search_pred_space_))
-          grid_open_.push(search_pred_space_);
-        else
-          grid_open_.make_heap();
+    } else {
+      // underconsistent, reopen the state and everything that may depend on it
+      search_exp_space_->heuristic = INFINITECOST;
+      RecomputeHeuristicRHS(search_exp_space_);
+      UpdateHeuristicEntry(search_exp_space_);
+      for (int dir = 0; dir < NUM_OF_HEURISTIC_SEARCH_DIR; dir++) {
+        int new_x = exp_x + heuristic_dx_[dir];
+        int new_y = exp_y + heuristic_dy_[dir];
+        if (!IsWithinMapCell(new_x, new_y)) continue;
+        EnvironmentEntry2D* entry = GetHeuristicEntry(new_x, new_y);
+        RecomputeHeuristicRHS(entry);
+        UpdateHeuristicEntry(entry);
       }
     }
 
@@ -370,25 +824,28 @@ bool Environment::ComputeHeuristicValues() {
 
   // set lower bounds for the remaining states
   if (!grid_open_.empty())
-    largest_computed_heuristic_ = grid_open_.top()->heuristic;
+    largest_computed_heuristic_ = grid_open_.top()->key;
   else
     largest_computed_heuristic_ = INFINITECOST;
 
-  delete[] grid_closed;
-
   return true;
 }
 
 int Environment::ComputeActionCost(int source_x, int source_y, int source_theta, Action* action) {
+  num_of_collision_checks_++;
+  // most actions stay inside the map, check them without bounds tests
+  if (IsWithinMapCell(source_x + action->min_cell.x, source_y + action->min_cell.y) &&
+      IsWithinMapCell(source_x + action->max_cell.x, source_y + action->max_cell.y)) {
+    return ComputeActionCostWithinMap(source_x, source_y, action);
+  }
+
   XYCell cell;
   XYThetaCell interm_cell;
 
   int end_x = source_x + action->dx;
   int end_y = source_y + action->dy;
 
-  // TODO(chenkan): - go over bounding box (minpt and maxpt) to test validity and skip
-  // testing boundaries below, also order intersect cells so that the four
-  // farthest pts go first
+  // TODO(chenkan): - order intersect cells so that the four farthest pts go first
 
   if (!IsCellSafe(source_x, source_y)) return INFINITECOST;
   if (!IsCellSafe(end_x, end_y)) return INFINITECOST;
@@ -425,21 +882,174 @@ int Environment::ComputeActionCost(int source_x, int source_y, int source_theta,
   return action->cost * (static_cast<int>(max_cost) + 1);  // use cell cost as multiplicative factor
 }
 
-void Environment::GetPreds(EnvironmentEntry3D* entry, std::vector<EnvironmentEntry3D*>* pred_entries, std::vector<int>* costs) {
-  // TODO(chenkan): to support tolerance, need:
-  //  a) generate preds for goal state based on all possible goal state variable settings,
-  //  b) change goal check condition in gethashentry c) change
-  //    getpredsofchangedcells and getsuccsofchangedcells functions
+int Environment::ComputeActionCostWithinMap(int source_x, int source_y, Action* action) {
+  const unsigned char* source = &cell_costs_[source_x * size_y_ + source_y];
+  int end_offset = action->dx * static_cast<int>(size_y_) + action->dy;
+
+  // unsafe cells are CELL_COST_UNSAFE, so one max over the cells checks them all
+  unsigned char max_cost = 0;
+  const int* offsets = action->interm_cell_offsets.data();
+  for (unsigned int i = 0; i < action->interm_cell_offsets.size(); ++i) {
+    max_cost = std::max(max_cost, source[offsets[i]]);
+  }
+  unsigned char end_cost = std::max(source[0], source[end_offset]);
+  if (max_cost == CELL_COST_UNSAFE || end_cost == CELL_COST_UNSAFE) return INFINITECOST;
+
+  // check collisions that for the particular circle_center orientation along the action,
+  // not needed if center cells are farther from unsafe cells than circle centers from them
+  if (max_cost >= cost_possibly_circumscribed_thresh_ && circle_center_.size() > 1) {
+    const uint16_t* clearance = &clearance_sq_[source_x * size_y_ + source_y];
+    int min_clearance_sq = clearance_cap_sq_;
+    for (unsigned int i = 0; i < action->interm_cell_offsets.size(); ++i) {
+      min_clearance_sq = std::min<int>(min_clearance_sq, clearance[offsets[i]]);
+    }
+    if (min_clearance_sq <= action->circle_center_reach_sq) {
+      offsets = action->circle_center_cell_offsets.data();
+      for (unsigned int i = 0; i < action->circle_center_cell_offsets.size(); ++i) {
+        if (source[offsets[i]] == CELL_COST_UNSAFE) return INFINITECOST;
+      }
+    }
+  }
+
+  // to ensure consistency of h2D:
+  max_cost = std::max(max_cost, end_cost);
+
+  return action->cost * (static_cast<int>(max_cost) + 1);  // use cell cost as multiplicative factor
+}
+
+int Environment::ComputeOptimisticActionCost(int source_x, int source_y, Action* action) {
+  int end_x = source_x + action->dx;
+  int end_y = source_y + action->dy;
+  if (!IsWithinMapCell(source_x, source_y) || !IsWithinMapCell(end_x, end_y)) return INFINITECOST;
+
+  // intermediate cells can only raise max cost, so this never exceeds ComputeActionCost
+  unsigned char end_cost = std::max(cell_costs_[source_x * size_y_ + source_y], cell_costs_[end_x * size_y_ + end_y]);
+  if (end_cost == CELL_COST_UNSAFE) return INFINITECOST;
+
+  return action->cost * (static_cast<int>(end_cost) + 1);
+}
+
+double Environment::GetCostCellRatio(int min_x, int min_y, int max_x, int max_y) {
+  min_x = std::max(min_x, 0);
+  min_y = std::max(min_y, 0);
+  max_x = std::min(max_x, static_cast<int>(size_x_) - 1);
+  max_y = std::min(max_y, static_cast<int>(size_y_) - 1);
+  if (min_x > max_x || min_y > max_y || cost_cell_sums_.empty()) return 0.0;
+
+  int stride = size_y_ + 1;
+  const int* sums = &cost_cell_sums_[0];
+  int count = sums[(max_x + 1) * stride + max_y + 1] - sums[min_x * stride + max_y + 1] -
+              sums[(max_x + 1) * stride + min_y] + sums[min_x * stride + min_y];
+  return static_cast<double>(count) / ((max_x - min_x + 1) * (max_y - min_y + 1));
+}
+
+void Environment::ComputeHeadingCones() {
+  turn_step_cost_ = INFINITECOST;
+  for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+    for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+      const Action* action = actions_[angle_index][mprim_index];
+      int turns = abs(NORMALIZEDISCTHETA(action->end_theta - action->start_theta, num_of_angles_));
+      turns = std::min(turns, num_of_angles_ - turns);
+      if (turns > 0) turn_step_cost_ = std::min<int>(turn_step_cost_, action->cost / turns);
+    }
+  }
+  if (turn_step_cost_ == INFINITECOST) turn_step_cost_ = 0;
+
+  int width_x = 2 * size_x_ - 1;
+  int width_y = 2 * size_y_ - 1;
+  heading_cone_ids_.resize(width_x * width_y);
+  heading_cones_.clear();
+  unsigned int last_cone = 0;
+  for (int dy = 1 - static_cast<int>(size_y_); dy < static_cast<int>(size_y_); ++dy) {
+    for (int dx = 1 - static_cast<int>(size_x_); dx < static_cast<int>(size_x_); ++dx) {
+      uint32_t cone = 0;
+      for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+        for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+          const Action* action = actions_[angle_index][mprim_index];
+          // any heading will do for start cell
+          if (action->dx * dx + action->dy * dy > 0 || (dx == 0 && dy == 0)) cone |= 1u << angle_index;
+        }
+      }
+      // neighbors mostly share the cone
+      if (last_cone >= heading_cones_.size() || heading_cones_[last_cone] != cone) {
+        last_cone = std::find(heading_cones_.begin(), heading_cones_.end(), cone) - heading_cones_.begin();
+        if (last_cone == heading_cones_.size()) heading_cones_.push_back(cone);
+      }
+      heading_cone_ids_[(dy + size_y_ - 1) * width_x + dx + size_x_ - 1] = last_cone;
+    }
+  }
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] %d heading cones, turn step cost %d",
+                static_cast<int>(heading_cones_.size()), turn_step_cost_);
+}
+
+void Environment::ComputeStartTurnCosts(int start_theta) {
+  turn_costs_start_theta_ = start_theta;
+  start_turn_costs_.resize(heading_cones_.size() * num_of_angles_);
+  for (unsigned int cone = 0; cone < heading_cones_.size(); ++cone) {
+    for (int theta = 0; theta < num_of_angles_; ++theta) {
+      int min_turns = INFINITECOST;
+      for (int heading = 0; heading < num_of_angles_; ++heading) {
+        if (!(heading_cones_[cone] & (1u << heading))) continue;
+        int turns_in = abs(heading - start_theta);
+        int turns_out = abs(theta - heading);
+        turns_in = std::min(turns_in, num_of_angles_ - turns_in);
+        turns_out = std::min(turns_out, num_of_angles_ - turns_out);
+        min_turns = std::min(min_turns, turns_in + turns_out);
+      }
+      start_turn_costs_[cone * num_of_angles_ + theta] = min_turns == INFINITECOST ? 0 : min_turns * turn_step_cost_;
+    }
+  }
+}
+
+void Environment::SetPrimitiveMask(unsigned int mask) {
+  succ_actions_.assign(num_of_angles_, std::vector<Action*>());
+  pred_actions_.assign(num_of_angles_, std::vector<Action*>());
+  for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+    for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+      if (!(mask & (1u << mprim_index))) continue;
+      Action* action = actions_[angle_index][mprim_index];
+      succ_actions_[angle_index].push_back(action);
+      pred_actions_[NORMALIZEDISCTHETA(action->end_theta, num_of_angles_)].push_back(action);
+    }
+  }
+}
 
+unsigned int Environment::GetMaxNumOfActions() {
+  unsigned int max_num_of_actions = num_of_prims_per_angle_;
+  for (const auto& action_list : pred_actions_) {
+    max_num_of_actions = std::max<unsigned int>(max_num_of_actions, action_list.size());
+  }
+  // one more for the edge to super start
+  return max_num_of_actions + 1;
+}
+
+void Environment::GetPreds(EnvironmentEntry3D* entry, std::vector<EnvironmentEntry3D*>* pred_entries,
+                           std::vector<int>* costs, std::vector<Action*>* actions, bool optimistic) {
   // for performance remove this, none of the three could be NULL
   // if (entry == NULL || pred_entries == NULL || costs == NULL) return;
 
+  if (actions != NULL) {
+    actions->clear();
+    actions->reserve(num_of_prims_per_angle_);
+  }
+
   // clear the successor array
   pred_entries->clear();
   costs->clear();
   pred_entries->reserve(num_of_prims_per_angle_);
   costs->reserve(num_of_prims_per_angle_);
 
+  // virtual states, preds of super goal are the goal set, super start has none
+  if (entry->x < 0) {
+    if (entry != super_goal_) return;
+    for (const auto& goal_entry : goal_set_) {
+      pred_entries->push_back(goal_entry);
+      costs->push_back(0);
+      if (actions != NULL) actions->push_back(NULL);
+    }
+    return;
+  }
+
   // iterate through actions
   std::vector<Action*>* action_list = &pred_actions_[static_cast<unsigned int>(entry->theta)];
   Action* action = NULL;
@@ -450,13 +1060,25 @@ void Environment::GetPreds(EnvironmentEntry3D* entry, std::vector<EnvironmentEnt
     pred_x = entry->x - action->dx;
     pred_y = entry->y - action->dy;
     pred_theta = action->start_theta;
+    if (action->action_index == LONG_RANGE_FORWARD && !IsLongRangeCell(pred_x, pred_y)) continue;
 
     // get cost
-    cost = ComputeActionCost(pred_x, pred_y, pred_theta, action);
+    if (optimistic) {
+      cost = ComputeOptimisticActionCost(pred_x, pred_y, action);
+    } else {
+      cost = ComputeActionCost(pred_x, pred_y, pred_theta, action);
+    }
     if (cost >= INFINITECOST) continue;
 
-    pred_entries->push_back(&env_[pred_x][pred_y][pred_theta]);
+    pred_entries->push_back(GetEnvEntry(pred_x, pred_y, pred_theta));
     costs->push_back(cost);
+    if (actions != NULL) actions->push_back(action);
+  }
+
+  if (entry->endpoint & ENDPOINT_START_SET) {
+    pred_entries->push_back(super_start_);
+    costs->push_back(0);
+    if (actions != NULL) actions->push_back(NULL);
   }
 }
 
@@ -477,17 +1099,33 @@ void Environment::GetSuccs(EnvironmentEntry3D* entry, std::vector<EnvironmentEnt
   succ_entries->reserve(num_of_prims_per_angle_);
   costs->reserve(num_of_prims_per_angle_);
 
-  // goal state should be absorbing
-  if (entry->x == goal_cell_.x && entry->y == goal_cell_.y && entry->theta == goal_cell_.theta) { 
-    GAUSSIAN_INFO("[SBPL_environment] current entry in goal cell");
+  // virtual states, succs of super start are the start set, super goal has none
+  if (entry->x < 0) {
+    if (entry != super_start_) return;
+    for (const auto& start_entry : start_set_) {
+      succ_entries->push_back(start_entry);
+      costs->push_back(0);
+      if (actions != NULL) actions->push_back(NULL);
+    }
+    return;
+  }
+
+  // states of goal set should be absorbing, they only lead to super goal
+  if (entry->endpoint & ENDPOINT_GOAL_SET) {
+    succ_entries->push_back(super_goal_);
+    costs->push_back(0);
+    if (actions != NULL) actions->push_back(NULL);
     return;
   }
 
   // iterate through actions
+  std::vector<Action*>* action_list = &succ_actions_[static_cast<unsigned int>(entry->theta)];
   Action* action = NULL;
   int new_x, new_y, new_theta, cost;
-  for (int aind = 0; aind < num_of_prims_per_angle_; aind++) {
-    action = actions_[static_cast<unsigned int>(entry->theta)][aind];
+  bool long_range = IsLongRangeCell(entry->x, entry->y);
+  for (unsigned int aind = 0; aind < action_list->size(); aind++) {
+    action = action_list->at(aind);
+    if (action->action_index == LONG_RANGE_FORWARD && !long_range) continue;
     new_x = entry->x + action->dx;
     new_y = entry->y + action->dy;
     new_theta = NORMALIZEDISCTHETA(action->end_theta, num_of_angles_);
@@ -496,7 +1134,7 @@ void Environment::GetSuccs(EnvironmentEntry3D* entry, std::vector<EnvironmentEnt
     cost = ComputeActionCost(entry->x, entry->y, entry->theta, action);
     if (cost >= INFINITECOST) continue;
 
-    succ_entries->push_back(&env_[new_x][new_y][new_theta]);
+    succ_entries->push_back(GetEnvEntry(new_x, new_y, new_theta));
     costs->push_back(cost);
     if (actions != NULL) actions->push_back(action);
   }
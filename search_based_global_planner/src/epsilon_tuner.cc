@@ -0,0 +1,157 @@
+/* Copyright(C) Gaussian Automation. All rights reserved.
+*/
+
+#include "search_based_global_planner/epsilon_tuner.h"
+#include <gslib/gaussian_debug.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "search_based_global_planner/utils.h"
+
+// save the table after this many learning plans, and on destruction
+#define EPSILON_TUNING_SAVE_PERIOD 10
+
+namespace search_based_global_planner {
+
+// upper bounds of all buckets but the last
+const double DISTANCE_BUCKET_BOUNDS[NUM_OF_DISTANCE_BUCKETS - 1] = {1.0, 2.0, 4.0, 8.0, 16.0};  // meters
+const double CLUTTER_BUCKET_BOUNDS[NUM_OF_CLUTTER_BUCKETS - 1] = {0.05, 0.15, 0.3};
+
+EpsilonTuner::EpsilonTuner()
+  : enabled_(false), initial_epsilon_(1.0), min_time_(0.0), max_time_(0.0), target_ratio_(1.0),
+    num_of_levels_(1), last_bucket_(-1), num_of_unsaved_samples_(0) {
+  // do nothing
+}
+
+EpsilonTuner::~EpsilonTuner() {
+  if (num_of_unsaved_samples_ > 0) Save();
+}
+
+void EpsilonTuner::Initialize(double initial_epsilon, double min_time, double max_time,
+                              double target_percentage, const std::string& table_file) {
+  initial_epsilon_ = std::max(1.0, initial_epsilon);
+  max_time_ = max_time;
+  min_time_ = std::min(min_time, max_time);
+  table_file_ = table_file;
+  // rounds go from initial epsilon down to 1 by 1
+  num_of_levels_ = 1 + static_cast<int>(ceil(initial_epsilon_ - 1.0 - 1e-6));
+  enabled_ = target_percentage > 0.0;
+  if (!enabled_) return;
+  if (num_of_levels_ > MAX_EPSILON_LEVELS) {
+    GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] epsilon tuning is disabled, initial epsilon %.3f is too large",
+                  initial_epsilon_);
+    enabled_ = false;
+    return;
+  }
+  target_ratio_ = 100.0 / std::min(100.0, target_percentage);
+
+  EpsilonTuningBucket empty_bucket;
+  memset(&empty_bucket, 0, sizeof(empty_bucket));
+  buckets_.assign(NUM_OF_DISTANCE_BUCKETS * NUM_OF_CLUTTER_BUCKETS, empty_bucket);
+  if (!table_file_.empty() && Load()) {
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] epsilon tuning table loaded from %s", table_file_.c_str());
+  }
+}
+
+bool EpsilonTuner::ChooseSchedule(double distance, double clutter, double* initial_epsilon, double* stop_time) {
+  *initial_epsilon = initial_epsilon_;
+  *stop_time = max_time_;
+  last_bucket_ = -1;
+  if (!enabled_) return false;
+
+  int distance_bucket = 0;
+  while (distance_bucket < NUM_OF_DISTANCE_BUCKETS - 1 && distance >= DISTANCE_BUCKET_BOUNDS[distance_bucket]) {
+    ++distance_bucket;
+  }
+  int clutter_bucket = 0;
+  while (clutter_bucket < NUM_OF_CLUTTER_BUCKETS - 1 && clutter >= CLUTTER_BUCKET_BOUNDS[clutter_bucket]) {
+    ++clutter_bucket;
+  }
+  int index = distance_bucket * NUM_OF_CLUTTER_BUCKETS + clutter_bucket;
+  EpsilonTuningBucket& bucket = buckets_[index];
+  bucket.num_of_plans++;
+  if (bucket.num_of_samples < MIN_EPSILON_TUNING_SAMPLES || bucket.num_of_plans % EPSILON_EXPLORATION_PERIOD == 0) {
+    last_bucket_ = index;
+    return true;
+  }
+
+  // greediest level which is good enough, level of epsilon 1 always is
+  for (int level = 0; level < num_of_levels_; ++level) {
+    if (bucket.cost_ratio[level] <= target_ratio_ || level == num_of_levels_ - 1) {
+      *initial_epsilon = std::max(1.0, initial_epsilon_ - level);
+      break;
+    }
+  }
+  *stop_time = std::min(max_time_, std::max(min_time_, EPSILON_STOP_TIME_MARGIN * bucket.target_time));
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] tuned schedule of bucket %d: epsilon %.3f, stop time %.3f",
+                index, *initial_epsilon, *stop_time);
+  return false;
+}
+
+void EpsilonTuner::Record(const std::vector<double>& round_end_times, const std::vector<int>& round_costs) {
+  if (last_bucket_ < 0) return;
+  EpsilonTuningBucket& bucket = buckets_[last_bucket_];
+  last_bucket_ = -1;
+  // round i of a learning plan is at level i, the last one is at epsilon 1
+  if (round_costs.size() != static_cast<size_t>(num_of_levels_) || round_end_times.size() != round_costs.size()) {
+    return;
+  }
+  double final_cost = round_costs.back();
+  if (final_cost <= 0) return;
+
+  double rate = bucket.num_of_samples == 0 ? 1.0 : EPSILON_TUNING_RATE;
+  double target_time = round_end_times.back();
+  for (int level = num_of_levels_ - 1; level >= 0; --level) {
+    double ratio = round_costs[level] / final_cost;
+    if (ratio <= target_ratio_) target_time = round_end_times[level];
+    bucket.cost_ratio[level] += rate * (ratio - bucket.cost_ratio[level]);
+  }
+  bucket.target_time += rate * (target_time - bucket.target_time);
+  bucket.num_of_samples++;
+
+  if (++num_of_unsaved_samples_ >= EPSILON_TUNING_SAVE_PERIOD) Save();
+}
+
+bool EpsilonTuner::Load() {
+  FILE* file = fopen(table_file_.c_str(), "rb");
+  if (!file) return false;
+  EpsilonTuningHeader header;
+  std::vector<EpsilonTuningBucket> buckets(buckets_.size());
+  // a table of another schedule tells nothing
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, "SBPLEPST", sizeof(header.magic)) == 0 &&
+               header.version == EPSILON_TUNING_VERSION &&
+               header.num_of_levels == static_cast<uint32_t>(num_of_levels_) &&
+               header.initial_epsilon == initial_epsilon_ &&
+               fread(&buckets[0], sizeof(EpsilonTuningBucket), buckets.size(), file) == buckets.size() &&
+               fgetc(file) == EOF;
+  fclose(file);
+
+  if (!valid) {
+    GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] ignore invalid epsilon tuning table %s", table_file_.c_str());
+    return false;
+  }
+  buckets_.swap(buckets);
+  return true;
+}
+
+bool EpsilonTuner::Save() {
+  num_of_unsaved_samples_ = 0;
+  if (!enabled_ || table_file_.empty()) return false;
+
+  EpsilonTuningHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SBPLEPST", sizeof(header.magic));
+  header.version = EPSILON_TUNING_VERSION;
+  header.num_of_levels = num_of_levels_;
+  header.initial_epsilon = initial_epsilon_;
+  bool ok = WriteFileAtomically(table_file_, [&](FILE* file) {
+    return fwrite(&header, sizeof(header), 1, file) == 1 &&
+           fwrite(&buckets_[0], sizeof(EpsilonTuningBucket), buckets_.size(), file) == buckets_.size();
+  });
+  if (!ok) GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] can't write epsilon tuning table %s", table_file_.c_str());
+  return ok;
+}
+
+}  // namespace search_based_global_planner
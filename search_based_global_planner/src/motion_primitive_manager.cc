@@ -13,14 +13,44 @@
 
 #include <ros/ros.h>
 #include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <Eigen/Dense>
 #include <fixpattern_path/path.h>
+#include <algorithm>
+#include <functional>
+#include <queue>
 
 #include "search_based_global_planner/utils.h"
 #include "search_based_global_planner/environment.h"
 
 namespace search_based_global_planner {
 
+// FNV-1a
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// remaining is what's left of the file, so that sizes of a corrupt file don't allocate more than it holds
+template<typename T>
+static bool ReadArray(FILE* file, size_t* remaining, uint32_t size, std::vector<T>* array) {
+  if (*remaining < size * sizeof(T)) return false;
+  *remaining -= size * sizeof(T);
+  array->resize(size);
+  return size == 0 || fread(&(*array)[0], sizeof(T), size, file) == size;
+}
+
+template<typename T>
+static bool WriteArray(FILE* file, const std::vector<T>& array) {
+  return array.empty() || fwrite(&array[0], sizeof(T), array.size(), file) == array.size();
+}
+
 MPrimitiveManager::MPrimitiveManager(Environment* env) {
   env_                          = env;
   resolution_                   = env_->resolution_;
@@ -37,7 +67,24 @@ MPrimitiveManager::MPrimitiveManager(Environment* env) {
 
 MPrimitiveManager::~MPrimitiveManager() { }
 
-void MPrimitiveManager::GenerateMotionPrimitives() {
+void MPrimitiveManager::GenerateMotionPrimitives(const std::string& cache_dir) {
+  env_->actions_.resize(num_of_angles_);
+  for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
+    env_->actions_[angle_index].resize(num_of_prims_per_angle_);
+  }
+
+  uint64_t key = ComputeCacheKey();
+  std::string cache_file;
+  if (!cache_dir.empty()) {
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "/sbpl_mprims_%016llx.bin", static_cast<unsigned long long>(key));
+    cache_file = cache_dir + file_name;
+    if (LoadActions(cache_file, key)) {
+      GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] motion primitives loaded from %s", cache_file.c_str());
+      return;
+    }
+  }
+
   // 0 degrees
   std::vector<std::vector<int>> mprim_cell_0;
   mprim_cell_0.resize(num_of_prims_per_angle_);
@@ -47,6 +94,7 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
   mprim_cell_0[SHORT_FORWARD] = {1, 0, 0, forward_cost_mult_};
   mprim_cell_0[NORMAL_FORWARD] = {8, 0, 0, forward_cost_mult_};
   mprim_cell_0[LONG_FORWARD] = {16, 0, 0, forward_cost_mult_};
+  mprim_cell_0[LONG_RANGE_FORWARD] = {16 * LONG_RANGE_PRIM_SCALE, 0, 0, forward_cost_mult_};
 /*  // 1/16 theta change
   mprim_cell_0[FORWARD_TURN_LEFT] = {8, 1, 1, forward_and_turn_cost_mult_};
   mprim_cell_0[FORWARD_TURN_RIGHT] = {8, -1, -1, forward_and_turn_cost_mult_};
@@ -63,6 +111,7 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
   mprim_cell_45[SHORT_FORWARD] = {1, 1, 0, forward_cost_mult_};
   mprim_cell_45[NORMAL_FORWARD] = {6, 6, 0, forward_cost_mult_};
   mprim_cell_45[LONG_FORWARD] = {12, 12, 0, forward_cost_mult_};
+  mprim_cell_45[LONG_RANGE_FORWARD] = {12 * LONG_RANGE_PRIM_SCALE, 12 * LONG_RANGE_PRIM_SCALE, 0, forward_cost_mult_};
 /*  // 1/16 theta change
   mprim_cell_45[FORWARD_TURN_LEFT] = {5, 7, 1, forward_and_turn_cost_mult_};
   mprim_cell_45[FORWARD_TURN_RIGHT] = {7, 5, -1, forward_and_turn_cost_mult_};
@@ -80,6 +129,7 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
   mprim_cell_22p5[SHORT_FORWARD] = {2, 1, 0, forward_cost_mult_};
   mprim_cell_22p5[NORMAL_FORWARD] = {6, 3, 0, forward_cost_mult_};
   mprim_cell_22p5[LONG_FORWARD] = {14, 6, 0, forward_cost_mult_};
+  mprim_cell_22p5[LONG_RANGE_FORWARD] = {14 * LONG_RANGE_PRIM_SCALE, 6 * LONG_RANGE_PRIM_SCALE, 0, forward_cost_mult_};
 /*  // 1/16 theta change
   mprim_cell_22p5[FORWARD_TURN_LEFT] = {5, 4, 1, forward_and_turn_cost_mult_};
   mprim_cell_22p5[FORWARD_TURN_RIGHT] = {7, 2, -1, forward_and_turn_cost_mult_};
@@ -88,13 +138,8 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
   mprim_cell_22p5[IN_PLACE_ROTATE_LEFT] = {0, 0, 1, turn_in_place_cost_mult_};
   mprim_cell_22p5[IN_PLACE_ROTATE_RIGHT] = {0, 0, -1, turn_in_place_cost_mult_};
 
-  env_->actions_.resize(num_of_angles_);
-  env_->pred_actions_.resize(num_of_angles_);
-
   // iterate over angles
   for (int angle_index = 0; angle_index < num_of_angles_; ++angle_index) {
-    env_->actions_[angle_index].resize(num_of_prims_per_angle_);
-    // env_->pred_actions_[angle_index].resize(num_of_prims_per_angle_);
     for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
       // current angle
       double current_angle = angle_index * 2 * M_PI / num_of_angles_;
@@ -140,7 +185,8 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
       XYThetaCell end_cell(end_cell_x, end_cell_y, end_cell_theta);
 
       // generate intermediate poses (remember they are w.r.t 0,0 (and not centers of the cells)
-      int num_of_interm_pts = 10;
+      // long range primitives keep the spacing of points of the others
+      int num_of_interm_pts = mprim_index == LONG_RANGE_FORWARD ? 9 * LONG_RANGE_PRIM_SCALE + 1 : 10;
       std::vector<XYThetaPoint> interm_pts;
       std::vector<IntermPointStruct> interm_struct;
       interm_pts.resize(num_of_interm_pts);
@@ -174,7 +220,7 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
             } else if(mprim_index == NORMAL_FORWARD) { // linear primitive 16
               interm_struct[i].max_vel = 0.4;
               //interm_struct[i].highlight = fixpattern_path::Path::MAX_HIGHLIGHT_DISTANCE;
-            } else if(mprim_index == LONG_FORWARD) { // linear primitive 32
+            } else if(mprim_index == LONG_FORWARD || mprim_index == LONG_RANGE_FORWARD) { // linear primitive 32
               interm_struct[i].max_vel = 0.6;
               //interm_struct[i].highlight = fixpattern_path::Path::MAX_HIGHLIGHT_DISTANCE;
             }
@@ -243,16 +289,280 @@ void MPrimitiveManager::GenerateMotionPrimitives() {
       mprims_.push_back(mprim);
 
       // we'll transform motion primitives to actions
-      Action* action = CreateAction(mprim);
-      ComputeReplanningDataForAction(action);
-      env_->actions_[angle_index][mprim_index] = action;
-
-      // add to the list of pred actions
-      int target_theta_cell = end_cell_theta;
-      if (target_theta_cell < 0) target_theta_cell = target_theta_cell + num_of_angles_;
-      env_->pred_actions_[target_theta_cell].push_back(action);
+      AddAction(angle_index, mprim_index, CreateAction(mprim));
     }
   }
+
+  if (!cache_file.empty() && SaveActions(cache_file, key)) {
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] motion primitives saved to %s", cache_file.c_str());
+  }
+}
+
+void MPrimitiveManager::AddAction(int angle_index, int mprim_index, Action* action) {
+  ComputeReplanningDataForAction(action);
+  ComputeCollisionDataForAction(action);
+  // lists of succ and pred actions are built by Environment::SetPrimitiveMask
+  env_->actions_[angle_index][mprim_index] = action;
+}
+
+uint64_t MPrimitiveManager::ComputeCacheKey() {
+  uint64_t key = 14695981039346656037ull;
+  // layout of the cached data
+  uint32_t layout[] = {MPRIM_CACHE_VERSION, sizeof(MPrimCacheAction), sizeof(XYCell), sizeof(XYThetaCell),
+                       sizeof(XYThetaPoint), sizeof(IntermPointStruct)};
+  key = HashBytes(key, layout, sizeof(layout));
+  // everything actions are computed from
+  int params[] = {num_of_angles_, num_of_prims_per_angle_, forward_cost_mult_,
+                  forward_and_turn_cost_mult_, turn_in_place_cost_mult_};
+  key = HashBytes(key, params, sizeof(params));
+  key = HashBytes(key, &resolution_, sizeof(resolution_));
+  key = HashBytes(key, &nominalvel_mpersec_, sizeof(nominalvel_mpersec_));
+  key = HashBytes(key, &timetoturn45degsinplace_secs_, sizeof(timetoturn45degsinplace_secs_));
+  for (const auto& p : footprint_) {
+    key = HashBytes(key, &p.x, sizeof(p.x));
+    key = HashBytes(key, &p.y, sizeof(p.y));
+  }
+  // separate footprint from circle centers
+  uint32_t num_of_footprint_points = footprint_.size();
+  key = HashBytes(key, &num_of_footprint_points, sizeof(num_of_footprint_points));
+  for (const auto& p : circle_center_) {
+    key = HashBytes(key, &p.x, sizeof(p.x));
+    key = HashBytes(key, &p.y, sizeof(p.y));
+  }
+  return key;
+}
+
+bool MPrimitiveManager::LoadActions(const std::string& file_name, uint64_t key) {
+  FILE* file = fopen(file_name.c_str(), "rb");
+  if (!file) return false;
+  struct stat file_stat;
+  if (fstat(fileno(file), &file_stat) != 0) {
+    fclose(file);
+    return false;
+  }
+  size_t remaining = file_stat.st_size;
+
+  MPrimCacheHeader header;
+  bool valid = remaining >= sizeof(header) && fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, "SBPLMPRM", sizeof(header.magic)) == 0 &&
+               header.version == MPRIM_CACHE_VERSION && header.key == key &&
+               header.num_of_actions == static_cast<uint32_t>(num_of_angles_ * num_of_prims_per_angle_);
+  if (valid) remaining -= sizeof(header);
+
+  std::vector<Action*> actions;
+  for (uint32_t i = 0; valid && i < header.num_of_actions; ++i) {
+    MPrimCacheAction record;
+    if (remaining < sizeof(record) || fread(&record, sizeof(record), 1, file) != 1) {
+      valid = false;
+      break;
+    }
+    remaining -= sizeof(record);
+    if (record.start_theta != static_cast<int>(i / num_of_prims_per_angle_) ||
+        record.action_index != static_cast<int>(i % num_of_prims_per_angle_)) {
+      valid = false;
+      break;
+    }
+
+    Action* action = new Action();
+    actions.push_back(action);
+    action->action_index = record.action_index;
+    action->start_theta = record.start_theta;
+    action->dx = record.dx;
+    action->dy = record.dy;
+    action->end_theta = record.end_theta;
+    action->cost = record.cost;
+    action->distance = record.distance;
+    valid = ReadArray(file, &remaining, record.num_of_intersecting_cells, &action->intersecting_cells) &&
+            ReadArray(file, &remaining, record.num_of_circle_center_cells, &action->circle_center_cells) &&
+            ReadArray(file, &remaining, record.num_of_interm_pts, &action->interm_pts) &&
+            ReadArray(file, &remaining, record.num_of_interm_cells_3d, &action->interm_cells_3d) &&
+            ReadArray(file, &remaining, record.num_of_interm_struct, &action->interm_struct);
+  }
+  fclose(file);
+
+  // the actions must be followed by nothing
+  if (!valid || remaining != 0) {
+    GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] ignore invalid motion primitive cache %s", file_name.c_str());
+    for (auto& action : actions) delete action;
+    return false;
+  }
+  for (unsigned int i = 0; i < actions.size(); ++i) {
+    AddAction(i / num_of_prims_per_angle_, i % num_of_prims_per_angle_, actions[i]);
+  }
+  return true;
+}
+
+bool MPrimitiveManager::SaveActions(const std::string& file_name, uint64_t key) {
+  MPrimCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SBPLMPRM", sizeof(header.magic));
+  header.version = MPRIM_CACHE_VERSION;
+  header.num_of_actions = num_of_angles_ * num_of_prims_per_angle_;
+  header.key = key;
+
+  bool saved = WriteFileAtomically(file_name, [&](FILE* file) {
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (int angle_index = 0; ok && angle_index < num_of_angles_; ++angle_index) {
+      for (int mprim_index = 0; ok && mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+        const Action* action = env_->actions_[angle_index][mprim_index];
+        MPrimCacheAction record;
+        memset(&record, 0, sizeof(record));
+        record.action_index = action->action_index;
+        record.start_theta = action->start_theta;
+        record.dx = action->dx;
+        record.dy = action->dy;
+        record.end_theta = action->end_theta;
+        record.cost = action->cost;
+        record.distance = action->distance;
+        record.num_of_intersecting_cells = action->intersecting_cells.size();
+        record.num_of_circle_center_cells = action->circle_center_cells.size();
+        record.num_of_interm_pts = action->interm_pts.size();
+        record.num_of_interm_cells_3d = action->interm_cells_3d.size();
+        record.num_of_interm_struct = action->interm_struct.size();
+        ok = fwrite(&record, sizeof(record), 1, file) == 1 &&
+             WriteArray(file, action->intersecting_cells) &&
+             WriteArray(file, action->circle_center_cells) &&
+             WriteArray(file, action->interm_pts) &&
+             WriteArray(file, action->interm_cells_3d) &&
+             WriteArray(file, action->interm_struct);
+      }
+    }
+    return ok;
+  });
+  if (!saved) GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] can't write motion primitive cache %s", file_name.c_str());
+  return saved;
+}
+
+void MPrimitiveManager::GenerateFreeSpaceHeuristic(int radius, const std::string& cache_dir) {
+  std::vector<int>* table = &env_->free_space_heuristic_;
+  table->clear();
+  if (radius <= 0) return;
+
+  uint32_t layout[] = {FREE_SPACE_HEURISTIC_CACHE_VERSION, FREE_SPACE_HEURISTIC_SEARCH_SCALE,
+                       static_cast<uint32_t>(radius)};
+  uint64_t key = HashBytes(ComputeCacheKey(), layout, sizeof(layout));
+  std::string cache_file;
+  if (!cache_dir.empty()) {
+    char file_name[64];
+    snprintf(file_name, sizeof(file_name), "/sbpl_fsh_%016llx.bin", static_cast<unsigned long long>(key));
+    cache_file = cache_dir + file_name;
+    if (LoadFreeSpaceHeuristic(cache_file, key, radius, table)) {
+      GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] free space heuristic loaded from %s", cache_file.c_str());
+      return;
+    }
+  }
+
+  double start_time = GetTimeInSeconds();
+  ComputeFreeSpaceHeuristic(radius, table);
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] free space heuristic of radius %d cost %lf seconds",
+                radius, GetTimeInSeconds() - start_time);
+
+  if (!cache_file.empty() && SaveFreeSpaceHeuristic(cache_file, key, radius, *table)) {
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] free space heuristic saved to %s", cache_file.c_str());
+  }
+}
+
+void MPrimitiveManager::ComputeFreeSpaceHeuristic(int radius, std::vector<int>* table) {
+  // table is indexed by start theta, dy, dx, theta, see Environment::GetHeuristic
+  int width = 2 * radius + 1;
+  table->assign(num_of_angles_ * width * width * num_of_angles_, INFINITECOST);
+
+  // dijkstra from every start theta in a bigger box
+  int box_radius = FREE_SPACE_HEURISTIC_SEARCH_SCALE * radius;
+  int box_width = 2 * box_radius + 1;
+  std::vector<int> costs(box_width * box_width * num_of_angles_);
+  typedef std::pair<int, int> CostIndex;
+  std::priority_queue<CostIndex, std::vector<CostIndex>, std::greater<CostIndex> > open;
+  for (int start_theta = 0; start_theta < num_of_angles_; ++start_theta) {
+    std::fill(costs.begin(), costs.end(), INFINITECOST);
+    // cost of the cheapest path leaving the box, a path which leaves the box
+    // and comes back costs no less than it plus going back straight
+    int escape_cost = INFINITECOST;
+    int start_index = (box_radius * box_width + box_radius) * num_of_angles_ + start_theta;
+    costs[start_index] = 0;
+    open.push(CostIndex(0, start_index));
+    while (!open.empty()) {
+      CostIndex top = open.top();
+      open.pop();
+      if (top.first != costs[top.second]) continue;
+      int theta = top.second % num_of_angles_;
+      int x = (top.second / num_of_angles_) % box_width;
+      int y = top.second / num_of_angles_ / box_width;
+      for (int mprim_index = 0; mprim_index < num_of_prims_per_angle_; ++mprim_index) {
+        const Action* action = env_->actions_[theta][mprim_index];
+        int new_x = x + action->dx;
+        int new_y = y + action->dy;
+        int new_theta = NORMALIZEDISCTHETA(action->end_theta, num_of_angles_);
+        int cost = top.first + static_cast<int>(action->cost);
+        if (new_x < 0 || new_y < 0 || new_x >= box_width || new_y >= box_width) {
+          escape_cost = std::min(escape_cost, cost);
+          continue;
+        }
+        int index = (new_y * box_width + new_x) * num_of_angles_ + new_theta;
+        if (cost < costs[index]) {
+          costs[index] = cost;
+          open.push(CostIndex(cost, index));
+        }
+      }
+    }
+    while (!open.empty()) open.pop();
+
+    for (int dy = -radius; dy <= radius; ++dy) {
+      for (int dx = -radius; dx <= radius; ++dx) {
+        int back_distance = box_radius + 1 - std::max(abs(dx), abs(dy));
+        int escape_bound = std::min<double>(INFINITECOST, escape_cost +
+            floor(COSTMULT_MTOMM * back_distance * resolution_ / nominalvel_mpersec_));
+        const int* box_costs = &costs[((dy + box_radius) * box_width + dx + box_radius) * num_of_angles_];
+        int* table_costs = &(*table)[((start_theta * width + dy + radius) * width + dx + radius) * num_of_angles_];
+        for (int theta = 0; theta < num_of_angles_; ++theta) {
+          table_costs[theta] = std::min(box_costs[theta], escape_bound);
+        }
+      }
+    }
+  }
+}
+
+bool MPrimitiveManager::LoadFreeSpaceHeuristic(const std::string& file_name, uint64_t key, int radius,
+                                               std::vector<int>* table) {
+  FILE* file = fopen(file_name.c_str(), "rb");
+  if (!file) return false;
+  int width = 2 * radius + 1;
+  size_t size = num_of_angles_ * width * width * num_of_angles_;
+  FreeSpaceHeuristicCacheHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               memcmp(header.magic, "SBPLFSHT", sizeof(header.magic)) == 0 &&
+               header.version == FREE_SPACE_HEURISTIC_CACHE_VERSION && header.key == key &&
+               header.radius == static_cast<uint32_t>(radius);
+  if (valid) {
+    table->resize(size);
+    // the table must be followed by nothing
+    valid = fread(&(*table)[0], sizeof(int), size, file) == size && fgetc(file) == EOF;
+  }
+  fclose(file);
+
+  if (!valid) {
+    GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] ignore invalid free space heuristic cache %s", file_name.c_str());
+    table->clear();
+  }
+  return valid;
+}
+
+bool MPrimitiveManager::SaveFreeSpaceHeuristic(const std::string& file_name, uint64_t key, int radius,
+                                               const std::vector<int>& table) {
+  FreeSpaceHeuristicCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "SBPLFSHT", sizeof(header.magic));
+  header.version = FREE_SPACE_HEURISTIC_CACHE_VERSION;
+  header.radius = radius;
+  header.key = key;
+
+  bool saved = WriteFileAtomically(file_name, [&](FILE* file) {
+    return fwrite(&header, sizeof(header), 1, file) == 1 && WriteArray(file, table);
+  });
+  if (!saved) {
+    GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] can't write free space heuristic cache %s", file_name.c_str());
+  }
+  return saved;
 }
 
 Action* MPrimitiveManager::CreateAction(const MotionPrimitive& mprim) {
@@ -335,24 +645,46 @@ Action* MPrimitiveManager::CreateAction(const MotionPrimitive& mprim) {
   return action;
 }
 
-void MPrimitiveManager::ComputeReplanningDataForAction(Action* action) {
-  unsigned int j;
+void MPrimitiveManager::ComputeCollisionDataForAction(Action* action) {
+  // offsets in Environment::cell_costs_, which is x major
+  int size_y = env_->size_y_;
+  action->min_cell = XYCell(std::min<int>(0, action->dx), std::min<int>(0, action->dy));
+  action->max_cell = XYCell(std::max<int>(0, action->dx), std::max<int>(0, action->dy));
+
+  action->interm_cell_offsets.clear();
+  for (unsigned int i = 0; i < action->interm_cells_3d.size(); ++i) {
+    const XYThetaCell& cell = action->interm_cells_3d[i];
+    action->interm_cell_offsets.push_back(cell.x * size_y + cell.y);
+    action->min_cell = XYCell(std::min(action->min_cell.x, cell.x), std::min(action->min_cell.y, cell.y));
+    action->max_cell = XYCell(std::max(action->max_cell.x, cell.x), std::max(action->max_cell.y, cell.y));
+  }
 
-  std::vector<XYThetaCell>* affected_pred_cells = &env_->affected_pred_cells_;
+  action->circle_center_cell_offsets.clear();
+  action->circle_center_reach_sq = 0;
+  for (unsigned int i = 0; i < action->circle_center_cells.size(); ++i) {
+    const XYCell& cell = action->circle_center_cells[i];
+    action->circle_center_cell_offsets.push_back(cell.x * size_y + cell.y);
+    int reach_sq = INFINITECOST;
+    for (const auto& interm_cell : action->interm_cells_3d) {
+      int dx = cell.x - interm_cell.x, dy = cell.y - interm_cell.y;
+      reach_sq = std::min(reach_sq, dx * dx + dy * dy);
+    }
+    action->circle_center_reach_sq = std::max(action->circle_center_reach_sq, reach_sq);
+    action->min_cell = XYCell(std::min(action->min_cell.x, cell.x), std::min(action->min_cell.y, cell.y));
+    action->max_cell = XYCell(std::max(action->max_cell.x, cell.x), std::max(action->max_cell.y, cell.y));
+  }
+}
 
+void MPrimitiveManager::ComputeReplanningDataForAction(Action* action) {
   // iterate over all the cells involved in the action
-  XYThetaCell start_cell, end_cell;
+  XYThetaCell start_cell;
   for (unsigned int i = 0; i < action->intersecting_cells.size(); i++) {
     // compute the translated affected search Pose - what state has an
     // outgoing action whose intersecting cell is at 0,0
     start_cell.theta = action->start_theta;
     start_cell.x = -action->intersecting_cells.at(i).x;
     start_cell.y = -action->intersecting_cells.at(i).y;
-
-    for (j = 0; j < affected_pred_cells->size(); j++) {
-      if (affected_pred_cells->at(j) == start_cell) break;
-    }
-    if (j == affected_pred_cells->size()) affected_pred_cells->push_back(start_cell);
+    AddAffectedPredCell(start_cell);
   }  // over intersecting cells
 
   // add the centers since with h2d we are using these in cost computations
@@ -361,22 +693,21 @@ void MPrimitiveManager::ComputeReplanningDataForAction(Action* action) {
   start_cell.theta = action->start_theta;
   start_cell.x = -0;
   start_cell.y = -0;
-
-  for (j = 0; j < affected_pred_cells->size(); j++) {
-    if (affected_pred_cells->at(j) == start_cell) break;
-  }
-  if (j == affected_pred_cells->size()) affected_pred_cells->push_back(start_cell);
+  AddAffectedPredCell(start_cell);
 
   // ---intersecting cell = outcome state
   // compute the translated affected search Pose - what state has an outgoing action whose intersecting cell is at 0,0
   start_cell.theta = action->start_theta;
   start_cell.x = -action->dx;
   start_cell.y = -action->dy;
+  AddAffectedPredCell(start_cell);
+}
 
-  for (j = 0; j < affected_pred_cells->size(); j++) {
-    if (affected_pred_cells->at(j) == start_cell) break;
-  }
-  if (j == affected_pred_cells->size()) affected_pred_cells->push_back(start_cell);
+void MPrimitiveManager::AddAffectedPredCell(const XYThetaCell& cell) {
+  // offsets are far below 2^23 cells and theta below 2^8
+  uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(cell.x)) << 32) |
+                 (static_cast<uint32_t>(cell.y) << 8) | static_cast<uint8_t>(cell.theta);
+  if (affected_pred_cell_keys_.insert(key).second) env_->affected_pred_cells_.push_back(cell);
 }
 
 };  // namespace search_based_global_planner
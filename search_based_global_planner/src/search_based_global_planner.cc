@@ -3,8 +3,13 @@
 
 #include "search_based_global_planner/search_based_global_planner.h"
 #include <angles/angles.h>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
+#include <cstring>
 
 #include <nav_msgs/Path.h>
+#include <std_msgs/String.h>
 //#include <costmap_2d/inflation_layer.h>
 #ifdef DEBUG
 #include <gperftools/profiler.h>
@@ -12,9 +17,15 @@
 
 #include "search_based_global_planner/utils.h"
 
-#define COMPUTEKEY(entry) (entry)->ComputeKey(eps_, env_->GetHeuristic((entry)->x, (entry)->y))
-#define CHECK_INPLACE_ROTATE(action) (action.action_index == IN_PLACE_ROTATE_LEFT || action.action_index == IN_PLACE_ROTATE_RIGHT)
-#define CHECK_SHORT_FORWARD(action) (action.action_index == SHORT_FORWARD)
+#define COMPUTEKEY(entry) (entry)->ComputeKey(eps_, env_->GetHeuristic((entry)->x, (entry)->y, (entry)->theta))
+#define CHECK_INPLACE_ROTATE(action) ((action).action_index == IN_PLACE_ROTATE_LEFT || (action).action_index == IN_PLACE_ROTATE_RIGHT)
+#define CHECK_SHORT_FORWARD(action) ((action).action_index == SHORT_FORWARD)
+// window is moved only when start is more than map_size_ / WINDOW_RECENTER_DIVISOR off its center
+#define WINDOW_RECENTER_DIVISOR 8
+// epsilon rounds beyond this are left out of the statistics topic
+#define MAX_PUBLISHED_EPSILON_ROUNDS 16
+// clutter of a plan is measured in the box of start and goal grown by this many meters
+#define EPSILON_TUNING_CLUTTER_MARGIN 1.0
 
 const double MAX_HIGHLIGHT_DIS = fixpattern_path::Path::MAX_HIGHLIGHT_DISTANCE * 2.0 / 3.0;
 const double LOW_HIGHLIGHT_DIS = 0.7;
@@ -23,11 +34,45 @@ const double MIN_HIGHLIGHT_DIS = fixpattern_path::Path::MIN_HIGHLIGHT_DISTANCE;
 //const double LOW_VEL = 0.4; 
 //const double MIN_VEL = 0.0; 
 
+
 namespace search_based_global_planner {
 
-SearchBasedGlobalPlanner::SearchBasedGlobalPlanner() : initialized_(false) { }
+// variants of the members of portfolio, used in turn when there are more members
+typedef struct {
+  double epsilon_scale;        // initial epsilon is scaled by it
+  unsigned int primitive_mask;
+} PortfolioVariant;
+
+const PortfolioVariant PORTFOLIO_VARIANTS[] = {
+  // greedier, to get the first path of hard goals sooner
+  {2.0, ALL_MPRIM_MASK},
+  // fewer branches, less expansions in open space
+  {1.0, ALL_MPRIM_MASK & ~(1u << SHORT_FORWARD)},
+  // in clutter long primitives mostly collide
+  {2.0, ALL_MPRIM_MASK & ~(1u << LONG_FORWARD) & ~(1u << LONG_RANGE_FORWARD)},
+};
+
+SearchBasedGlobalPlanner::SearchBasedGlobalPlanner()
+  : window_initialized_(false), affected_epoch_(0), inconsist_epoch_(1), learning_plan_(false),
+    lazy_evaluation_(false), initialized_(false), portfolio_index_(0), portfolio_owner_(this),
+    full_primitive_set_(true), portfolio_searching_(0), portfolio_reading_costmap_(0), portfolio_found_(false),
+    yield_to_portfolio_(false), reading_costmap_(false), stop_search_(false), stop_flag_(&stop_search_),
+    background_improvement_(false), slot_cost_(INFINITECOST), plan_version_(0), last_plan_version_(0) {
+  memset(&counters_, 0, sizeof(counters_));
+  stats_.num_of_allocations = 0;
+  stats_.found = false;
+  stats_.replan_reason = REPLAN_FIRST_PLAN;
+  stats_.cache_hit = false;
+  stats_.num_of_cache_lookups = stats_.num_of_cache_hits = 0;
+}
 
-SearchBasedGlobalPlanner::~SearchBasedGlobalPlanner() { }
+SearchBasedGlobalPlanner::~SearchBasedGlobalPlanner() {
+  CancelImprovement();
+  for (unsigned int i = 0; i < portfolio_.size(); ++i) {
+    delete portfolio_[i];
+  }
+  if (initialized_) delete env_;
+}
 
 double GetNumberFromXMLRPC(XmlRpc::XmlRpcValue& value, const std::string& full_param_name) {  // NOLINT
   // Make sure that the value we're looking at is either a double or an int.
@@ -89,7 +134,13 @@ void SearchBasedGlobalPlanner::initialize(std::string name, costmap_2d::Costmap2
   if (!initialized_) {
     initialized_ = true;
     ros::NodeHandle private_nh("~/" + name);
-    plan_pub_ = private_nh.advertise<nav_msgs::Path>("plan", 1);
+    // only instance 0 of portfolio publishes
+    if (portfolio_index_ == 0) plan_pub_ = private_nh.advertise<nav_msgs::Path>("plan", 1);
+    // SearchStatistics of every makePlan as text
+    private_nh.param("p21", publish_statistics_, false);
+    if (portfolio_index_ == 0 && publish_statistics_) {
+      statistics_pub_ = private_nh.advertise<std_msgs::String>("statistics", 10);
+    }
     costmap_ros_ = costmap_ros;
     costmap_ = costmap_ros_->getCostmap();
 
@@ -137,6 +188,7 @@ void SearchBasedGlobalPlanner::initialize(std::string name, costmap_2d::Costmap2
     inscribed_inflated_cost_ = lethal_cost_ - 1;
     cost_multiplier_ = static_cast<unsigned char>(costmap_2d::INSCRIBED_INFLATED_OBSTACLE / inscribed_inflated_cost_ + 1);
     cost_possibly_circumscribed_thresh = TransformCostmapCost(cost_possibly_circumscribed_thresh);
+    cost_possibly_circumscribed_thresh_ = cost_possibly_circumscribed_thresh;
     GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] cost_possibly_circumscribed_thresh: %d", static_cast<int>(cost_possibly_circumscribed_thresh));
 
     const int num_of_angles = 16;
@@ -149,6 +201,22 @@ void SearchBasedGlobalPlanner::initialize(std::string name, costmap_2d::Costmap2
 
     private_nh.param("p13", map_size_, 400);
     private_nh.param("p15", using_short_highlight_, true);
+    // motion primitives are cached in this directory, empty to disable
+    std::string default_mprim_cache_dir;
+    if (getenv("ROS_HOME")) {
+      default_mprim_cache_dir = getenv("ROS_HOME");
+    } else if (getenv("HOME")) {
+      default_mprim_cache_dir = std::string(getenv("HOME")) + "/.ros";
+    }
+    std::string mprim_cache_dir;
+    private_nh.param("p16", mprim_cache_dir, default_mprim_cache_dir);
+    // radius in cells of the free space heuristic table, 0 to disable
+    int free_space_heuristic_radius;
+    private_nh.param("p19", free_space_heuristic_radius, 32);
+    // long range primitives start only from states with no cost within this
+    // many meters, negative to disable
+    double long_range_clearance;
+    private_nh.param("p20", long_range_clearance, 0.5);
 		
 
     unsigned int size_x = costmap_->getSizeInCellsX();
@@ -168,9 +236,79 @@ void SearchBasedGlobalPlanner::initialize(std::string name, costmap_2d::Costmap2
                            cost_possibly_circumscribed_thresh, nominalvel_mpersec,
                            timetoturn45degsinplace_secs, footprint_point, circle_center_point,
                            num_of_angles, num_of_prims_per_angle, forward_cost_mult,
-                           forward_and_turn_cost_mult, turn_in_place_cost_mult);
+                           forward_and_turn_cost_mult, turn_in_place_cost_mult,
+                           free_space_heuristic_radius,
+                           long_range_clearance < 0 ? -1 : static_cast<int>(ceil(long_range_clearance / resolution_)),
+                           mprim_cache_dir);
 
-    need_to_reinitialize_environment_ = true;
+    for (int cost = 0; cost < 256; ++cost) {
+      cost_table_[cost] = TransformCostmapCost(static_cast<unsigned char>(cost));
+    }
+    window_costs_.resize(map_size_ * map_size_);
+    row_costs_.resize(map_size_);
+    SyncWindowCosts();
+
+    // no successor or predecessor list could outgrow these
+    unsigned int max_num_of_actions = env_->GetMaxNumOfActions();
+    succ_entries_buf_.reserve(max_num_of_actions);
+    succ_costs_buf_.reserve(max_num_of_actions);
+    succ_actions_buf_.reserve(max_num_of_actions);
+    pred_entries_buf_.reserve(max_num_of_actions);
+    pred_costs_buf_.reserve(max_num_of_actions);
+    pred_actions_buf_.reserve(max_num_of_actions);
+
+    need_to_reinitialize_environment_ = false;
+    RequestReinitialization(REPLAN_FIRST_PLAN);
+
+    // number of extra search instances of portfolio mode, 0 to disable
+    int portfolio_size;
+    private_nh.param("p17", portfolio_size, 0);
+    if (portfolio_index_ > 0) {
+      const PortfolioVariant& variant = PORTFOLIO_VARIANTS[(portfolio_index_ - 1) % (sizeof(PORTFOLIO_VARIANTS) / sizeof(PORTFOLIO_VARIANTS[0]))];
+      initial_epsilon_ = std::max(1.0, initial_epsilon_ * variant.epsilon_scale);
+      env_->SetPrimitiveMask(variant.primitive_mask);
+      full_primitive_set_ = variant.primitive_mask == ALL_MPRIM_MASK;
+    } else {
+      for (int i = 1; i <= portfolio_size; ++i) {
+        SearchBasedGlobalPlanner* member = new SearchBasedGlobalPlanner();
+        member->portfolio_index_ = i;
+        member->portfolio_owner_ = this;
+        member->stop_flag_ = &stop_search_;
+        member->initialize(name, costmap_ros);
+        portfolio_.push_back(member);
+      }
+      if (!portfolio_.empty()) {
+        GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] portfolio of %d more instances", (int)portfolio_.size());
+      }
+    }
+
+    // return the first path and improve it in background, portfolio mode always does
+    private_nh.param("p18", background_improvement_, false);
+    if (portfolio_index_ > 0 || !portfolio_.empty()) background_improvement_ = true;
+
+    // evaluate costs of actions lazily, only when their states get expanded
+    private_nh.param("p26", lazy_evaluation_, false);
+
+    // number of routes kept by the route cache, 0 to disable
+    private_nh.param("p22", route_cache_size_, 0);
+
+    // tune initial epsilon and stop time to reach p23 percent of the cost of
+    // epsilon 1 soonest, 0 to disable. Stop time is at least p25 seconds and
+    // the learned table is kept in file p24 if it's set
+    double tuning_target_percentage, min_stop_time;
+    std::string tuning_table_file;
+    private_nh.param("p23", tuning_target_percentage, 0.0);
+    private_nh.param("p24", tuning_table_file, std::string(""));
+    private_nh.param("p25", min_stop_time, 0.2);
+    if (tuning_target_percentage > 0.0 && (portfolio_index_ > 0 || !portfolio_.empty() || background_improvement_)) {
+      if (portfolio_index_ == 0) {
+        GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] epsilon tuning is disabled in portfolio mode or with background improvement");
+      }
+      tuning_target_percentage = 0.0;
+    }
+    epsilon_tuner_.Initialize(initial_epsilon_, min_stop_time, allocated_time_, tuning_target_percentage,
+                              tuning_table_file);
+    stop_time_ = allocated_time_;
     GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] Search Based Global Planner initialized");
   } else {
     GAUSSIAN_WARN("[SEARCH BASED GLOBAL PLANNER] This planner has already been initialized,"
@@ -192,6 +330,9 @@ void SearchBasedGlobalPlanner::setStaticCosmap(bool is_static) {
     costmap_ = costmap_ros_->getCostmap();
     GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] take normal costmap!");
   }
+  for (unsigned int i = 0; i < portfolio_.size(); ++i) {
+    portfolio_[i]->setStaticCosmap(is_static);
+  }
 }
 
 
@@ -220,24 +361,33 @@ void SearchBasedGlobalPlanner::PublishPlan(const std::vector<geometry_msgs::Pose
 }
 
 void SearchBasedGlobalPlanner::RecomputeRHSVal(EnvironmentEntry3D* entry) {
-  // rhs(s) = min... refer to paper
-  std::vector<EnvironmentEntry3D*> succ_entries;
-  std::vector<int> succ_costs;
-  env_->GetSuccs(entry, &succ_entries, &succ_costs);
+  // rhs(s) = min... refer to paper, rhs of super goal is always 0
+  if (entry == env_->GetSuperGoal()) return;
+  EnvironmentEntry3DCold* cold = env_->GetColdEntry(entry);
+  entry->rhs = INFINITECOST;
+  cold->best_next_entry = NULL;
+  cold->best_action = NULL;
+  cold->unverified = false;
+
+  std::vector<EnvironmentEntry3D*>& succ_entries = succ_entries_buf_;
+  std::vector<int>& succ_costs = succ_costs_buf_;
+  env_->GetSuccs(entry, &succ_entries, &succ_costs, &succ_actions_buf_);
   for (int i = 0; i < succ_entries.size(); ++i) {
     EnvironmentEntry3D* succ_entry = succ_entries[i];
-    if (succ_entry->visited_iteration != environment_iteration_) continue;
+    if (env_->GetColdEntry(succ_entry)->visited_iteration != environment_iteration_) continue;
     if (entry->rhs > succ_costs[i] + succ_entry->g) {
       entry->rhs = succ_costs[i] + succ_entry->g;
       // update parent entry
-      entry->best_next_entry = succ_entry;
+      cold->best_next_entry = succ_entry;
+      cold->best_action = succ_actions_buf_[i];
     }
   }
 }
 
 void SearchBasedGlobalPlanner::UpdateSetMembership(EnvironmentEntry3D* entry) {
   if (entry->rhs != entry->g) {
-    if (entry->closed_iteration != iteration_) {
+    EnvironmentEntry3DCold* cold = env_->GetColdEntry(entry);
+    if (cold->closed_iteration != iteration_) {
       COMPUTEKEY(entry);
       if (PTRHEAP_OK != open_.contain(entry)) {
 //        GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] push to open_ (%d %d %d)", entry->x, entry->y, entry->theta);
@@ -246,31 +396,37 @@ void SearchBasedGlobalPlanner::UpdateSetMembership(EnvironmentEntry3D* entry) {
 //        GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] update (%d %d %d)", entry->x, entry->y, entry->theta);
         open_.adjust(entry);
       }
-    } else {
-      inconsist_.insert(entry);
+      counters_.num_of_heap_operations++;
+    } else if (cold->inconsist_epoch != inconsist_epoch_) {
+      cold->inconsist_epoch = inconsist_epoch_;
+      inconsist_.push_back(entry);
     }
   } else {
     if (PTRHEAP_OK == open_.contain(entry)) {
 //      GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] erase from open_ (%d %d %d)", entry->x, entry->y, entry->theta);
       open_.erase(entry);
+      counters_.num_of_heap_operations++;
     }
   }
 }
 
 void SearchBasedGlobalPlanner::UpdateStateOfUnderConsist(EnvironmentEntry3D* entry) {
-  std::vector<EnvironmentEntry3D*> pred_entries;
-  std::vector<int> costs;
+  std::vector<EnvironmentEntry3D*>& pred_entries = pred_entries_buf_;
+  std::vector<int>& costs = pred_costs_buf_;
 
-  env_->GetPreds(entry, &pred_entries, &costs);
+  // only best_next_entry of preds matters, no need for their true costs
+  env_->GetPreds(entry, &pred_entries, &costs, NULL, lazy_evaluation_);
   for (int i = 0; i < pred_entries.size(); ++i) {
     EnvironmentEntry3D* pred_entry = pred_entries[i];
+    EnvironmentEntry3DCold* pred_cold = env_->GetColdEntry(pred_entry);
     // if entry was not visited before: entry->g = INFINITECOST
-    if (pred_entry->visited_iteration != environment_iteration_) {
+    if (pred_cold->visited_iteration != environment_iteration_) {
       pred_entry->g = INFINITECOST;
-      pred_entry->visited_iteration = environment_iteration_;
+      pred_cold->visited_iteration = environment_iteration_;
+      counters_.num_of_states_visited++;
     }
 
-    if (pred_entry->best_next_entry == entry) {
+    if (pred_cold->best_next_entry == entry) {
       RecomputeRHSVal(pred_entry);
       UpdateSetMembership(pred_entry);
     }
@@ -278,74 +434,84 @@ void SearchBasedGlobalPlanner::UpdateStateOfUnderConsist(EnvironmentEntry3D* ent
 }
 
 void SearchBasedGlobalPlanner::UpdateStateOfOverConsist(EnvironmentEntry3D* entry) {
-  std::vector<int> costs;
-  std::vector<EnvironmentEntry3D*> pred_entries;
+  std::vector<int>& costs = pred_costs_buf_;
+  std::vector<EnvironmentEntry3D*>& pred_entries = pred_entries_buf_;
 
-  env_->GetPreds(entry, &pred_entries, &costs);
+  env_->GetPreds(entry, &pred_entries, &costs, &pred_actions_buf_, lazy_evaluation_);
   for (int i = 0; i < pred_entries.size(); ++i) {
     EnvironmentEntry3D* pred_entry = pred_entries[i];
+    EnvironmentEntry3DCold* pred_cold = env_->GetColdEntry(pred_entry);
     // if entry was not visited before: entry->g = INFINITECOST
-    if (pred_entry->visited_iteration != environment_iteration_) {
+    if (pred_cold->visited_iteration != environment_iteration_) {
       pred_entry->g = INFINITECOST;
-      pred_entry->visited_iteration = environment_iteration_;
+      pred_cold->visited_iteration = environment_iteration_;
+      counters_.num_of_states_visited++;
     }
 
     if (pred_entry->rhs > costs[i] + entry->g) {
+      // an optimistic cost stays unverified only for preds never expanded,
+      // path extraction follows best actions of expanded ones
+      bool unverified = lazy_evaluation_ && pred_actions_buf_[i] != NULL;
+      if (unverified && pred_entry->g != INFINITECOST) {
+        costs[i] = env_->GetActionCost(pred_entry, pred_actions_buf_[i]);
+        unverified = false;
+        if (costs[i] >= INFINITECOST || pred_entry->rhs <= costs[i] + entry->g) continue;
+      }
       // optimization: assume entry is the best
       pred_entry->rhs = costs[i] + entry->g;
       // update parent entry
-      pred_entry->best_next_entry = entry;
+      pred_cold->best_next_entry = entry;
+      pred_cold->best_action = pred_actions_buf_[i];
+      pred_cold->unverified = unverified;
 
       UpdateSetMembership(pred_entry);
     }
   }
 }
 
+bool SearchBasedGlobalPlanner::VerifyBestAction(EnvironmentEntry3D* entry) {
+  EnvironmentEntry3DCold* cold = env_->GetColdEntry(entry);
+  if (!cold->unverified) return true;
+  cold->unverified = false;
+
+  // rhs was taken from best_next_entry at the optimistic cost
+  int cost = env_->GetActionCost(entry, cold->best_action);
+  if (cost < INFINITECOST && cost + cold->best_next_entry->g == entry->rhs) return true;
+
+  // it costs more, take the best of evaluated succs and put entry back to OPEN
+  RecomputeRHSVal(entry);
+  UpdateSetMembership(entry);
+  return false;
+}
+
 bool SearchBasedGlobalPlanner::ComputeOrImprovePath() {
 #ifdef DEBUG
   size_t max_open_size = 0;
 #endif
-  // get start_entry_list
-  std::vector<EnvironmentEntry3D*> start_entry_list;
-  if (broader_start_and_goal_) {
-    std::vector<int> delta_x{-2, -1, 0, 1, 2};
-    std::vector<int> delta_y{-2, -1, 0, 1, 2};
-    int start_x = start_entry_->x;
-    int start_y = start_entry_->y;
-    uint8_t start_theta = start_entry_->theta;
-    for (const auto& i : delta_x) {
-      for (const auto& j : delta_y) {
-        if (i != 0 && j != 0) continue;
-        EnvironmentEntry3D* entry = env_->GetEnvEntry(start_x + i, start_y + j, start_theta);
-        if (entry) start_entry_list.push_back(entry);
-      }
-    }
-  } else {
-    start_entry_list.push_back(start_entry_);
-  }
-  first_met_entry_ = start_entry_;
+  // all start entries lead to super start at zero cost, so one check ends the search
+  EnvironmentEntry3D* super_start = env_->GetSuperStart();
   // begin compute
   EnvironmentEntry3D* min_entry = open_.top();
-  while (min_entry != NULL && GetTimeInSeconds() - start_time_ < allocated_time_) {
-    bool search_over = false;
-    for (const auto& start_entry : start_entry_list) {
-      if (COMPUTEKEY(min_entry) >= COMPUTEKEY(start_entry) && start_entry->rhs == start_entry->g) {
-        first_met_entry_ = start_entry;
-        search_over = true;
-        break;
-      }
+  while (min_entry != NULL && GetTimeInSeconds() - start_time_ < GetTimeLimit() && !*stop_flag_ &&
+         !YieldedToPortfolio()) {
+    if (COMPUTEKEY(min_entry) >= COMPUTEKEY(super_start) && super_start->rhs == super_start->g) break;
+    // rhs of an over-consistent entry must be true before it becomes its g
+    if (min_entry->g > min_entry->rhs && !VerifyBestAction(min_entry)) {
+      min_entry = open_.top();
+      continue;
     }
-    if (search_over) break;
 #ifdef DEBUG
     if (open_.size() > max_open_size) max_open_size = open_.size();
 #endif
     // remove state s with the minimum key from OPEN
     // GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] expand entry in open_ (%d %d %d)", min_entry->x, min_entry->y, min_entry->theta);
     open_.pop();
+    counters_.num_of_expansions++;
+    counters_.num_of_heap_operations++;
     if (min_entry->g > min_entry->rhs) {
       min_entry->g = min_entry->rhs;
       // push to CLOSED
-      min_entry->closed_iteration = iteration_;
+      env_->GetColdEntry(min_entry)->closed_iteration = iteration_;
       // for all s' from Pred(s) UpdateState(s')
       UpdateStateOfOverConsist(min_entry);
     } else {
@@ -360,14 +526,18 @@ bool SearchBasedGlobalPlanner::ComputeOrImprovePath() {
   GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] max_open_size: %d", (int)max_open_size);
 #endif
 
-  if (first_met_entry_->rhs == INFINITECOST && open_.empty()) {
+  if (super_start->rhs == INFINITECOST && open_.empty()) {
     GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] solution does not exist: search exited because heap is empty");
     return false;
+  } else if (YieldedToPortfolio() && !open_.empty() &&
+             !(COMPUTEKEY(min_entry) >= COMPUTEKEY(super_start) && super_start->rhs == super_start->g)) {
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] search gave way to the path of another instance");
+    return false;
   } else if (!open_.empty() &&
-             (min_entry->key < COMPUTEKEY(first_met_entry_) || first_met_entry_->rhs > first_met_entry_->g)) {
+             (min_entry->key < COMPUTEKEY(super_start) || super_start->rhs > super_start->g)) {
     GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] search exited because it ran out of time");
     return false;
-  } else if (first_met_entry_->rhs == INFINITECOST && !open_.empty()) {
+  } else if (super_start->rhs == INFINITECOST && !open_.empty()) {
     GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] solution does not exist: search exited because all candidates for expansion have infinite heuristics");
     return false;
   } else {
@@ -377,15 +547,14 @@ bool SearchBasedGlobalPlanner::ComputeOrImprovePath() {
 }
 
 void SearchBasedGlobalPlanner::GetEntryPath(std::vector<EnvironmentEntry3D*>* entry_path) {
-  std::vector<int> costs;
-  std::vector<EnvironmentEntry3D*> succ_entries;
-
-  EnvironmentEntry3D* entry = first_met_entry_;
-
-  entry_path->push_back(entry);
-
-  while (*entry != *goal_entry_) {
-    if (entry->best_next_entry == NULL) {
+  // virtual states are not part of the path, it runs from the start entry
+  // chosen by super start to the goal entry leading to super goal
+  EnvironmentEntry3D* super_goal = env_->GetSuperGoal();
+  EnvironmentEntry3D* entry = env_->GetSuperStart();
+
+  while (true) {
+    EnvironmentEntry3D* best_next_entry = env_->GetColdEntry(entry)->best_next_entry;
+    if (best_next_entry == NULL) {
       GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] path does not exist since best_next_entry == NULL");
       break;
     }
@@ -399,12 +568,13 @@ void SearchBasedGlobalPlanner::GetEntryPath(std::vector<EnvironmentEntry3D*>* en
       return;
     }
 
-    entry = entry->best_next_entry;
+    entry = best_next_entry;
+    if (entry == super_goal) break;
 
     entry_path->push_back(entry);
   }
 
-  if (*entry != *goal_entry_) {
+  if (entry != super_goal || entry_path->empty()) {
     GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] Failed to GetSearchPath");
     entry_path->clear();
   }
@@ -415,11 +585,11 @@ void SearchBasedGlobalPlanner::GetPointPathFromEntryPath(const std::vector<Envir
                                                          std::vector<IntermPointStruct>* path_info) {
   if (entry_path.size() == 0) return;
 
-  std::vector<EnvironmentEntry3D*> succ_entries;
-  std::vector<int> costs;
-  std::vector<Action*> actions;
-  std::vector<Action> actions_path;
-//  std::vector<Actions_Path> actions_path;
+  // the search is done, so its successor buffers are free to use
+  std::vector<EnvironmentEntry3D*>& succ_entries = succ_entries_buf_;
+  std::vector<int>& costs = succ_costs_buf_;
+  std::vector<Action*>& actions = succ_actions_buf_;
+  actions_path_.clear();
 
   point_path->clear();
   path_info->clear();
@@ -428,26 +598,25 @@ void SearchBasedGlobalPlanner::GetPointPathFromEntryPath(const std::vector<Envir
     EnvironmentEntry3D* source_entry = entry_path.at(pind);
     EnvironmentEntry3D* target_entry = entry_path.at(pind + 1);
 
-    // get successors and pick the target via the cheapest action
-    succ_entries.clear();
-    costs.clear();
-    actions.clear();
-    env_->GetSuccs(source_entry, &succ_entries, &costs, &actions);
-//    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] GetSuccs_entries size = %d, costs size = %d, actions size = %d", (int)succ_entries.size(), (int)costs.size(), (int)actions.size());
-
-    int best_cost = INFINITECOST;
-    int best_index = -1;
-    for (unsigned int sind = 0; sind < succ_entries.size(); ++sind) {
-      if (*succ_entries[sind] == *target_entry && costs[sind] <= best_cost) {
-        best_cost = costs[sind];
-        best_index = sind;
+    // action chosen by the search, it's NULL only for entries whose best action
+    // was lost, virtual transitions are not part of entry_path
+    const Action* best_action = env_->GetColdEntry(source_entry)->best_action;
+    if (best_action == NULL) {
+      // get successors and pick the target via the cheapest action
+      succ_entries.clear();
+      costs.clear();
+      actions.clear();
+      env_->GetSuccs(source_entry, &succ_entries, &costs, &actions);
+
+      int best_cost = INFINITECOST;
+      for (unsigned int sind = 0; sind < succ_entries.size(); ++sind) {
+        if (*succ_entries[sind] == *target_entry && costs[sind] <= best_cost) {
+          best_cost = costs[sind];
+          best_action = actions[sind];
+        }
       }
     }
-    if (best_index == -1) {
-      if (broader_start_and_goal_) {
-        for (const auto& entry : goal_entry_list_)
-          if (*source_entry == *entry && *target_entry == *goal_entry_) break; //return;
-      }
+    if (best_action == NULL) {
       GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] successor not found for transition");
       point_path->clear();
       path_info->clear();
@@ -456,238 +625,378 @@ void SearchBasedGlobalPlanner::GetPointPathFromEntryPath(const std::vector<Envir
     // now push in the actual path
     double source_x = DISCXY2CONT(source_entry->x, resolution_);
     double source_y = DISCXY2CONT(source_entry->y, resolution_);
-    for (int ipind = 0; ipind < static_cast<int>(actions[best_index]->interm_pts.size()) - 1; ++ipind) {
+    for (int ipind = 0; ipind < static_cast<int>(best_action->interm_pts.size()) - 1; ++ipind) {
       // translate appropriately
-      XYThetaPoint interm_point = actions[best_index]->interm_pts[ipind];
+      XYThetaPoint interm_point = best_action->interm_pts[ipind];
       interm_point.x += source_x;
       interm_point.y += source_y;
 
       // store
       point_path->push_back(interm_point);
-  //    path_info->push_back(actions[best_index]->interm_struct[ipind]);
-		}
-    actions_path.push_back(*actions.at(best_index));
+    }
+    actions_path_.push_back(best_action);
   }
-//  GAUSSIAN_INFO("[SBPL] actions_path size = %d, point_path size = %d", (int)actions_path.size(), (int)point_path->size());
-  ComputeHighlightAndVelocity(actions_path, point_path, path_info);
+  ComputeHighlightAndVelocity(actions_path_, point_path, path_info);
 }
 
-void setActionIntermStruct(Action* action, double highlight, double max_vel, bool is_corner) {
-	for (int ipind = 0; ipind < static_cast<int>(action->interm_pts.size()) - 1; ++ipind) {
-		IntermPointStruct point_info = action->interm_struct[ipind];
-		action->interm_struct[ipind].highlight = highlight;
-		action->interm_struct[ipind].max_vel = max_vel;
-		action->interm_struct[ipind].is_corner = is_corner;
-  //  GAUSSIAN_INFO("[SBPL] point[%d]set max_vel = %lf", ipind, max_vel);
-	}
-}	
-
-void SearchBasedGlobalPlanner::ComputeHighlightAndVelocity(const std::vector<Action>& origin_actions_path, 
+void SearchBasedGlobalPlanner::ComputeHighlightAndVelocity(const std::vector<const Action*>& actions_path,
                                                          std::vector<XYThetaPoint>* point_path,
                                                          std::vector<IntermPointStruct>* path_info) {
-  std::vector<Action> actions_path = origin_actions_path;
-//  GAUSSIAN_INFO("[SBPL] 1: actions_path size = %d, path_point size = %d, path_info size = %d", (int)actions_path.size(),(int)point_path->size(), (int)path_info->size());
-  // check corner and set max_vel and highlight of action 
+  // check corner and set max_vel of each point, highlight is MIN_HIGHLIGHT_DIS for now
+  path_info->clear();
+  path_info->reserve(point_path->size());
   for (unsigned int pind = 0; pind < actions_path.size(); ++pind) {
-    unsigned int corner_size = 0;
-		double highlight= MIN_HIGHLIGHT_DIS;
-		double max_vel = sbpl_min_vel_;
-		bool is_corner = false;
-    if (CHECK_INPLACE_ROTATE(actions_path[pind])) {
-      corner_size = 1;
-      for (unsigned int i = pind + 1; i < actions_path.size(); ++i) {
-        if (CHECK_INPLACE_ROTATE(actions_path[i])) {
-          ++corner_size;
-        } else {
-          break;
-        }
+    unsigned int corner_size = 1;
+    double max_vel = sbpl_min_vel_;
+    bool is_corner = false;
+    if (CHECK_INPLACE_ROTATE(*actions_path[pind])) {
+      while (pind + corner_size < actions_path.size() && CHECK_INPLACE_ROTATE(*actions_path[pind + corner_size])) {
+        ++corner_size;
       }
-//      GAUSSIAN_INFO("[SBPL] corner size = %d", corner_size);
-      if(pind == 0 && corner_size >= 1) {
-        max_vel = sbpl_min_vel_;	
+      if (pind == 0) {
+        max_vel = sbpl_min_vel_;
+        is_corner = true;
+      } else if (corner_size == 1) {  // 22p5 digree
+        max_vel = sbpl_max_vel_;
+      } else if (corner_size <= 3) {  // 45 and 67.5 digree
+        max_vel = sbpl_low_vel_;
+      } else {  // > 67.5 digree
+        max_vel = sbpl_min_vel_;
         is_corner = true;
-      } else {	
-        if(corner_size == 1) {  // 22p5 digree
-          max_vel = sbpl_max_vel_;	
-          is_corner = false;
-        } else if(corner_size <= 3) { //45 and 67.5 digree
-          max_vel = sbpl_low_vel_;	
-          is_corner = false;
-        } else if(corner_size > 3) { // > 67.5 digree
-          max_vel = sbpl_min_vel_;	
-          is_corner = true;
-        }
-      }
-      for(unsigned int i = pind; i < pind + corner_size; ++i) {
-        actions_path.at(i).max_vel = max_vel;
-        actions_path.at(i).highlight = highlight;
-        setActionIntermStruct(&actions_path.at(i), highlight, max_vel, is_corner);
       }
-      pind += corner_size - 1;
-    } else if(CHECK_SHORT_FORWARD(actions_path.at(pind))) {
+    } else if (CHECK_SHORT_FORWARD(*actions_path[pind])) {
       max_vel = sbpl_low_vel_;
-      actions_path.at(pind).max_vel = sbpl_low_vel_;
-      setActionIntermStruct(&actions_path.at(pind), highlight, max_vel, is_corner);
     } else {
       max_vel = sbpl_max_vel_;
-      actions_path.at(pind).max_vel = sbpl_max_vel_;
-      setActionIntermStruct(&actions_path.at(pind), highlight, max_vel, is_corner);
     }
+
+    for (unsigned int i = pind; i < pind + corner_size; ++i) {
+      const std::vector<IntermPointStruct>& interm_struct = actions_path[i]->interm_struct;
+      for (int ipind = 0; ipind < static_cast<int>(interm_struct.size()) - 1; ++ipind) {
+        IntermPointStruct point_info = interm_struct[ipind];
+        point_info.highlight = MIN_HIGHLIGHT_DIS;
+        point_info.max_vel = max_vel;
+        point_info.is_corner = is_corner;
+        path_info->push_back(point_info);
+      }
+    }
+    pind += corner_size - 1;
   }
- 
-	// push action:interm_struct to path_info(including highlight and max_vel) 
-  for (unsigned int pind = 0; pind < actions_path.size(); ++pind) {
-    for (int ipind = 0; ipind < actions_path.at(pind).interm_struct.size() - 1; ++ipind) {
-      path_info->push_back(actions_path.at(pind).interm_struct[ipind]);
-		}
-	}
-	
-	// calculate hightlight based on max_vel of each point in path_info
-	double sum_highlight;
-  for (unsigned int i = 0; i < path_info->size(); ++i) {
-		if (path_info->at(i).max_vel != sbpl_min_vel_) {
-			sum_highlight = 0.0;
-			for (unsigned int j = i; j < path_info->size(); ++j) {
-				sum_highlight += path_info->at(j).distance;
-				if (sum_highlight > MAX_HIGHLIGHT_DIS) {
-					sum_highlight = MAX_HIGHLIGHT_DIS;
-					break;
-				}
-				if (path_info->at(j).max_vel == sbpl_min_vel_ || (path_info->at(j).max_vel == sbpl_low_vel_ && using_short_highlight_)) { //corner, cut highlight here
-					break;
-				}
+
+  // highlight of a point is the distance to the first corner or sharp turn
+  // ahead, clamped to MAX_HIGHLIGHT_DIS. Walk backwards with prefix sums of
+  // distance and turning: next corner is carried along, window end only moves
+  // back, and angles are only compared where the path turns by more than
+  // PI / 2 inside the window
+  int size = path_info->size();
+  std::vector<double>& sum_distance = sum_distance_;
+  std::vector<double>& sum_turning = sum_turning_;
+  sum_distance.assign(size + 1, 0.0);
+  sum_turning.assign(size + 1, 0.0);
+  for (int i = 0; i < size; ++i) {
+    sum_distance[i + 1] = sum_distance[i] + path_info->at(i).distance;
+    if (i + 1 < size) {
+      sum_turning[i + 1] = sum_turning[i] +
+          fabs(angles::shortest_angular_distance(point_path->at(i).theta, point_path->at(i + 1).theta));
+    }
+  }
+
+  int next_corner = size;      // first corner at or after i
+  int window_end = size + 1;   // first k > i with sum_distance[k] - sum_distance[i] > MAX_HIGHLIGHT_DIS
+  for (int i = size - 1; i >= 0; --i) {
+    const IntermPointStruct& point_info = path_info->at(i);
+    if (point_info.max_vel == sbpl_min_vel_ || (point_info.max_vel == sbpl_low_vel_ && using_short_highlight_)) {
+      next_corner = i;
+    }
+    while (window_end - 1 > i && sum_distance[window_end - 1] - sum_distance[i] > MAX_HIGHLIGHT_DIS) {
+      --window_end;
+    }
+    if (point_info.max_vel == sbpl_min_vel_) continue;
+
+    // highlight stops at the first of: window end, corner, sharp turn
+    int last = std::min(window_end - 1, next_corner);
+    int last_turn = std::min(last, size - 1);
+    // turning up to last_turn bounds the angle to any point before last,
+    // tiny margin for rounding
+    if (sum_turning[last_turn] - sum_turning[i] > M_PI / 2.0 - 1e-9) {
+      for (int j = i + 1; j < last; ++j) {
         // TODO(lizhen) check break theta
-        if (fabs(angles::shortest_angular_distance(point_path->at(i).theta, point_path->at(j).theta)) > M_PI / 2.0) { //path_info->at(j).max_vel == sbpl_max_vel && 
+        if (fabs(angles::shortest_angular_distance(point_path->at(i).theta, point_path->at(j).theta)) > M_PI / 2.0) {
+          last = j;
           break;
         }
-			}
-			if (sum_highlight > MAX_HIGHLIGHT_DIS) {
-				sum_highlight = MAX_HIGHLIGHT_DIS;
-			} else if(sum_highlight < LOW_HIGHLIGHT_DIS) {
-				sum_highlight = LOW_HIGHLIGHT_DIS;
-			}
-			path_info->at(i).highlight = sum_highlight;
-		}
-	}	
+      }
+    }
+
+    double sum_highlight;
+    if (last == size) {
+      sum_highlight = sum_distance[size] - sum_distance[i];
+    } else if (last == window_end - 1) {
+      sum_highlight = MAX_HIGHLIGHT_DIS;
+    } else {
+      sum_highlight = sum_distance[last + 1] - sum_distance[i];
+    }
+    if (sum_highlight > MAX_HIGHLIGHT_DIS) {
+      sum_highlight = MAX_HIGHLIGHT_DIS;
+    } else if (sum_highlight < LOW_HIGHLIGHT_DIS) {
+      sum_highlight = LOW_HIGHLIGHT_DIS;
+    }
+    path_info->at(i).highlight = sum_highlight;
+  }
 }
 
 void SearchBasedGlobalPlanner::ReInitializeSearchEnvironment() {
+  // entries are invalidated by ReInitialize, fetch start and goal again
+  XYThetaCell start_cell(start_entry_->x, start_entry_->y, start_entry_->theta);
+  XYThetaCell goal_cell(goal_entry_->x, goal_entry_->y, goal_entry_->theta);
   env_->ReInitialize();
+  start_entry_ = env_->GetEnvEntry(start_cell.x, start_cell.y, start_cell.theta);
+  goal_entry_ = env_->GetEnvEntry(goal_cell.x, goal_cell.y, goal_cell.theta);
 
   open_.clear();
-  inconsist_.clear();
+  ClearInconsist();
 
   eps_ = initial_epsilon_;
   epsilon_satisfied_ = INFINITECOST;
 
   environment_iteration_++;
 
-  goal_entry_list_.clear();
-
-  // put goal_entry_ to open_, entries around goal_entry_ too
+  // goal entry, entries around it too, lead to super goal which is put to open_
+  endpoint_entries_.clear();
+  endpoint_entries_.push_back(goal_entry_);
   if (broader_start_and_goal_) {
-    std::vector<int> delta_x{-3, -2, -1, 0, 1, 2, 3};
-    std::vector<int> delta_y{-3, -2, -1, 0, 1, 2, 3};
-    std::vector<int> delta_theta{0}; // -1, 0, 1
-    int goal_x = goal_entry_->x;
-    int goal_y = goal_entry_->y;
-    uint8_t goal_theta = goal_entry_->theta;
-    for (const auto& i : delta_x) {
-      for (const auto& j : delta_y) {
-        for (const auto& k : delta_theta) {
-          // if (i != 0 && j != 0) continue;
-
-          EnvironmentEntry3D* entry = env_->GetEnvEntry(goal_x + i, goal_y + j, goal_theta + k);
-          if (!entry) continue;
-          goal_entry_list_.push_back(entry);
-
-          entry->rhs = 0;
-          entry->visited_iteration = environment_iteration_;
-          if (i != 0 || j != 0) entry->best_next_entry = goal_entry_;
-          COMPUTEKEY(entry);
-          open_.push(entry);
-        }
+    for (int i = -3; i <= 3; ++i) {
+      for (int j = -3; j <= 3; ++j) {
+        if (i == 0 && j == 0) continue;
+        EnvironmentEntry3D* entry = env_->GetEnvEntry(goal_entry_->x + i, goal_entry_->y + j, goal_entry_->theta);
+        if (entry) endpoint_entries_.push_back(entry);
       }
     }
-  } else {
-    goal_entry_->rhs = 0;
-    goal_entry_->visited_iteration = environment_iteration_;
-    COMPUTEKEY(goal_entry_);
-    open_.push(goal_entry_);
   }
+  env_->SetGoalSet(endpoint_entries_);
+
+  EnvironmentEntry3D* super_goal = env_->GetSuperGoal();
+  super_goal->rhs = 0;
+  env_->GetColdEntry(super_goal)->visited_iteration = environment_iteration_;
+  COMPUTEKEY(super_goal);
+  open_.push(super_goal);
+  counters_.num_of_states_visited++;
+  counters_.num_of_heap_operations++;
 
   need_to_reinitialize_environment_ = false;
 }
 
+void SearchBasedGlobalPlanner::UpdateStartSet() {
+  // start entry, entries beside it too when broader_start_and_goal_ is on
+  endpoint_entries_.clear();
+  endpoint_entries_.push_back(start_entry_);
+  if (broader_start_and_goal_) {
+    for (int d = -2; d <= 2; ++d) {
+      if (d == 0) continue;
+      EnvironmentEntry3D* entry = env_->GetEnvEntry(start_entry_->x + d, start_entry_->y, start_entry_->theta);
+      if (entry) endpoint_entries_.push_back(entry);
+      entry = env_->GetEnvEntry(start_entry_->x, start_entry_->y + d, start_entry_->theta);
+      if (entry) endpoint_entries_.push_back(entry);
+    }
+  }
+  if (!env_->SetStartSet(endpoint_entries_)) return;
+
+  // super start now leads to other entries
+  EnvironmentEntry3D* super_start = env_->GetSuperStart();
+  EnvironmentEntry3DCold* cold = env_->GetColdEntry(super_start);
+  if (cold->visited_iteration != environment_iteration_) {
+    super_start->g = INFINITECOST;
+    cold->visited_iteration = environment_iteration_;
+    counters_.num_of_states_visited++;
+  }
+  RecomputeRHSVal(super_start);
+  UpdateSetMembership(super_start);
+}
+
+// one iteration of AD*: decrease eps_ if it's satisfied and improve path
+bool SearchBasedGlobalPlanner::ImprovePath() {
+  if (fabs(epsilon_satisfied_ - eps_) < 0.000001) {
+    // epsilon_satisfied_ != eps_ when first come to here
+    if (eps_ > 1.0) eps_ -= 1.0;
+    if (eps_ < 1.0) eps_ = 1.0;
+
+    // new iteration - CLOSED = empty
+    iteration_++;
+  }
+
+  // move states from INCONS into OPEN
+  for (const auto& e : inconsist_) {
+    // e shouldn't be in open_, because we'll check if e in open_ when push
+    // to inconsist_, if in, we'll remove it from open_ first
+    open_.push(e);
+  }
+  ClearInconsist();
+
+  // update the priorities for all s from OPEN according to key(s)
+  open_.rekey([this](EnvironmentEntry3D* entry) { COMPUTEKEY(entry); });
+  counters_.num_of_heap_operations += open_.size();
+
+  double start_time = GetTimeInSeconds();
+  bool found = ComputeOrImprovePath();
+  if (found) {
+    epsilon_satisfied_ = eps_;
+  }
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] ComputeOrImprovePath cost %lf seconds", GetTimeInSeconds() - start_time);
+  return found;
+}
+
 bool SearchBasedGlobalPlanner::search(std::vector<XYThetaPoint>* point_path, std::vector<IntermPointStruct>* path_info) {
   start_time_ = GetTimeInSeconds();
+  SearchCounters counters = counters_;
+  unsigned int num_of_collision_checks = env_->GetNumOfCollisionChecks();
 
+  stats_.replan_reason = need_to_reinitialize_environment_ ? reinitialize_reason_ : REPLAN_INCREMENTAL;
   if (need_to_reinitialize_environment_) {
     ReInitializeSearchEnvironment();
   }
+  UpdateStartSet();
+  if (epsilon_satisfied_ == INFINITECOST) ChooseEpsilonSchedule();
 
   double before_heuristic = GetTimeInSeconds();
   env_->EnsureHeuristicsUpdated();
-  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] EnsureHeuristicsUpdated cost %lf seconds", GetTimeInSeconds() - before_heuristic);
-
-  while (epsilon_satisfied_ > 1.0 && GetTimeInSeconds() - start_time_ < allocated_time_) {
-    if (fabs(epsilon_satisfied_ - eps_) < 0.000001) {
-      // epsilon_satisfied_ != eps_ when first come to here
-      if (eps_ > 1.0) eps_ -= 1.0;
-      if (eps_ < 1.0) eps_ = 1.0;
-
-      // new iteration - CLOSED = empty
-      iteration_++;
-    }
-
-    // move states from INCONS into OPEN
-    for (const auto& e : inconsist_) {
-      // e shouldn't be in open_, because we'll check if e in open_ when push
-      // to inconsist_, if in, we'll remove it from open_ first
-      open_.push(e);
-    }
-    inconsist_.clear();
-
-    // update the priorities for all s from OPEN according to key(s)
-    for (auto it = open_.begin(); it != open_.end(); ++it)
-      COMPUTEKEY(*it);
-    open_.make_heap();
+  stats_.heuristic_time = GetTimeInSeconds() - before_heuristic;
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] EnsureHeuristicsUpdated cost %lf seconds", stats_.heuristic_time);
+
+  double rounds_start_time = GetTimeInSeconds() - start_time_;
+  while (epsilon_satisfied_ > 1.0 && GetTimeInSeconds() - start_time_ < GetTimeLimit() && !*stop_flag_) {
+    EpsilonRoundStatistics round;
+    round.time = GetTimeInSeconds();
+    round.num_of_expansions = counters_.num_of_expansions;
+    round.found = ImprovePath();
+    round.epsilon = eps_;
+    round.cost = env_->GetSuperStart()->rhs;
+    round.time = GetTimeInSeconds() - round.time;
+    round.num_of_expansions = counters_.num_of_expansions - round.num_of_expansions;
+    stats_.rounds.push_back(round);
+    if (YieldedToPortfolio()) break;
+    if (env_->GetSuperStart()->rhs == INFINITECOST) break;
+    // return the first path, ImproveInBackground goes on
+    if (background_improvement_ && epsilon_satisfied_ != INFINITECOST) break;
+  }
 
-    double start_time = GetTimeInSeconds();
-    if (ComputeOrImprovePath()) {
-      epsilon_satisfied_ = eps_;
+  stats_.num_of_expansions = counters_.num_of_expansions - counters.num_of_expansions;
+  stats_.num_of_heap_operations = counters_.num_of_heap_operations - counters.num_of_heap_operations;
+  stats_.num_of_states_visited = counters_.num_of_states_visited - counters.num_of_states_visited;
+  stats_.num_of_states_generated = env_->GetNumOfEntries();
+  stats_.num_of_collision_checks = env_->GetNumOfCollisionChecks() - num_of_collision_checks;
+  stats_.epsilon_satisfied = epsilon_satisfied_;
+
+  if (learning_plan_) {
+    // only a full schedule tells how the cost converges
+    learning_plan_ = false;
+    round_end_times_.clear();
+    round_costs_.clear();
+    if (epsilon_satisfied_ <= 1.0 && !stats_.rounds.empty() && stats_.rounds[0].epsilon == initial_epsilon_) {
+      double end_time = rounds_start_time;
+      for (const auto& round : stats_.rounds) {
+        end_time += round.time;
+        round_end_times_.push_back(end_time);
+        round_costs_.push_back(round.cost);
+      }
     }
-    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] ComputeOrImprovePath cost %lf seconds", GetTimeInSeconds() - start_time);
-
-    if (first_met_entry_->rhs == INFINITECOST) break;
+    epsilon_tuner_.Record(round_end_times_, round_costs_);
   }
 
-  if (first_met_entry_->rhs == INFINITECOST || epsilon_satisfied_ == INFINITECOST) {
-    GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] cannot find a solution");
+  if (env_->GetSuperStart()->rhs == INFINITECOST || epsilon_satisfied_ == INFINITECOST) {
+    // the portfolio has a path already when this one gave way
+    if (!YieldedToPortfolio()) GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] cannot find a solution");
     return false;
   } else {
-    std::vector<EnvironmentEntry3D*> entry_path;
-    GetEntryPath(&entry_path);
-    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] GetEntryPath.size = %d", (int)entry_path.size());
-    GetPointPathFromEntryPath(entry_path, point_path, path_info);
+    double before_extraction = GetTimeInSeconds();
+    entry_path_.clear();
+    GetEntryPath(&entry_path_);
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] GetEntryPath.size = %d", (int)entry_path_.size());
+    GetPointPathFromEntryPath(entry_path_, point_path, path_info);
+    stats_.path_extraction_time = GetTimeInSeconds() - before_extraction;
     GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] solution found");
     return true;
   }
 }
 
-bool SearchBasedGlobalPlanner::CostsChanged(const std::vector<XYCell>& changed_cells) {
+void SearchBasedGlobalPlanner::ShiftWindow(int world_cell_x, int world_cell_y, int* shift_x, int* shift_y,
+                                           std::vector<EnvironmentEntry3D*>* border_entries) {
+  *shift_x = *shift_y = 0;
+  int half_size = map_size_ / 2;
+  if (window_initialized_ &&
+      abs(world_cell_x - (window_origin_x_ + half_size)) <= map_size_ / WINDOW_RECENTER_DIVISOR &&
+      abs(world_cell_y - (window_origin_y_ + half_size)) <= map_size_ / WINDOW_RECENTER_DIVISOR) {
+    return;
+  }
+
+  // center window at start, aligned to tiles and kept inside costmap as far
+  // as alignment allows
+  int origin_cell_x = static_cast<int>(floor(costmap_->getOriginX() / resolution_ + 0.5));
+  int origin_cell_y = static_cast<int>(floor(costmap_->getOriginY() / resolution_ + 0.5));
+  int min_x = origin_cell_x & ~ENTRY_TILE_MASK;
+  int min_y = origin_cell_y & ~ENTRY_TILE_MASK;
+  int max_x = std::max(min_x, static_cast<int>((origin_cell_x + costmap_->getSizeInCellsX() - map_size_) & ~ENTRY_TILE_MASK));
+  int max_y = std::max(min_y, static_cast<int>((origin_cell_y + costmap_->getSizeInCellsY() - map_size_) & ~ENTRY_TILE_MASK));
+  int new_origin_x = std::min(max_x, std::max(min_x, (world_cell_x - half_size) & ~ENTRY_TILE_MASK));
+  int new_origin_y = std::min(max_y, std::max(min_y, (world_cell_y - half_size) & ~ENTRY_TILE_MASK));
+
+  if (window_initialized_ && (new_origin_x != window_origin_x_ || new_origin_y != window_origin_y_)) {
+    int dx = new_origin_x - window_origin_x_;
+    int dy = new_origin_y - window_origin_y_;
+    *shift_x = dx;
+    *shift_y = dy;
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] shift window by (%d %d) cells", dx, dy);
+    if (abs(dx) >= map_size_ || abs(dy) >= map_size_) {
+      // nothing is kept
+      RequestReinitialization(REPLAN_WINDOW_JUMPED);
+      env_->ShiftWindow(dx, dy, NULL, NULL);
+      start_entry_ = goal_entry_ = NULL;
+    } else {
+      dropped_entries_.clear();
+      env_->ShiftWindow(dx, dy, &dropped_entries_, border_entries);
+      for (auto& entry : dropped_entries_) {
+        if (open_.contain(entry) == PTRHEAP_OK) open_.erase(entry);
+        env_->GetColdEntry(entry)->inconsist_epoch = 0;
+        if (entry == start_entry_) start_entry_ = NULL;
+        if (entry == goal_entry_) goal_entry_ = NULL;
+      }
+      inconsist_.erase(std::remove_if(inconsist_.begin(), inconsist_.end(), [this](EnvironmentEntry3D* entry) {
+        return env_->GetColdEntry(entry)->inconsist_epoch != inconsist_epoch_;
+      }), inconsist_.end());
+    }
+    SyncWindowCosts();
+  }
+  window_origin_x_ = new_origin_x;
+  window_origin_y_ = new_origin_y;
+  window_initialized_ = true;
+}
+
+bool SearchBasedGlobalPlanner::CostsChanged(const std::vector<XYCell>& changed_cells,
+                                            const std::vector<XYCell>& long_range_changed_cells,
+                                            const std::vector<EnvironmentEntry3D*>& border_entries) {
   if (need_to_reinitialize_environment_ || iteration_ == 0)
     return true;
 
   EnvironmentEntry3D* entry = NULL;
-  std::vector<EnvironmentEntry3D*> affected_entries;
-  char* exist = (char*)calloc(map_size_ * map_size_ * size_dir_, sizeof(char));  // NOLINT
-  if (!exist) {
-    GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] allocate memory for exist in CostsChanged failed");
-    exit(0);
+  std::vector<EnvironmentEntry3D*>& affected_entries = affected_entries_;
+  affected_entries.clear();
+  // only entries generated in this plan can be affected, index them by slot,
+  // stamps of earlier calls are stale once affected_epoch_ is bumped
+  if (affected_stamps_.size() < env_->GetNumOfEntries() + 1) {
+    affected_stamps_.resize(env_->GetNumOfEntries() + 1, 0);
   }
+  if (++affected_epoch_ == 0) {
+    std::fill(affected_stamps_.begin(), affected_stamps_.end(), 0);
+    affected_epoch_ = 1;
+  }
+  unsigned int* stamps = &affected_stamps_[0];
 
   double start_time = GetTimeInSeconds();
+  // entries near border of a moved window, only visited ones need an update
+  for (const auto& entry : border_entries) {
+    if (env_->GetColdEntry(entry)->visited_iteration != environment_iteration_) continue;
+    stamps[entry->slot] = affected_epoch_;
+    affected_entries.push_back(entry);
+  }
   for (const auto& cell : changed_cells) {
     // now iterate over all states that could potentially be affected
     std::vector<XYThetaCell>& affected_pred_cells = env_->GetAffectedPredCells();
@@ -696,34 +1005,45 @@ bool SearchBasedGlobalPlanner::CostsChanged(const std::vector<XYCell>& changed_c
       affected_cell.x = affected_cell.x + cell.x;
       affected_cell.y = affected_cell.y + cell.y;
 
-      entry = env_->GetEnvEntry(affected_cell.x, affected_cell.y, affected_cell.theta);
+      entry = env_->FindEnvEntry(affected_cell.x, affected_cell.y, affected_cell.theta);
       if (!entry) continue;
 
-      int index = affected_cell.theta + affected_cell.x * size_dir_ + affected_cell.y * map_size_ * size_dir_;
-      if (exist[index] == 1) continue;
-      exist[index] = 1;
+      if (stamps[entry->slot] == affected_epoch_) continue;
+      stamps[entry->slot] = affected_epoch_;
+      // long range actions reach far, don't count entries which need no update
+      if (env_->GetColdEntry(entry)->visited_iteration != environment_iteration_) continue;
 
       // insert to affected_entries
       affected_entries.push_back(entry);
     }
   }
-  // don't forget to free exist
-  free(exist);
-  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] CostsChanged cost %lf seconds, changed_cells.size() %d, affected_entries.size() %d",
-           GetTimeInSeconds() - start_time, (int)changed_cells.size(), (int)affected_entries.size());
+  // long range actions of all headings appear or disappear at these cells
+  for (const auto& cell : long_range_changed_cells) {
+    for (unsigned int theta = 0; theta < size_dir_; ++theta) {
+      entry = env_->FindEnvEntry(cell.x, cell.y, theta);
+      if (!entry) break;
+      if (stamps[entry->slot] == affected_epoch_) continue;
+      stamps[entry->slot] = affected_epoch_;
+      if (env_->GetColdEntry(entry)->visited_iteration != environment_iteration_) continue;
+      affected_entries.push_back(entry);
+    }
+  }
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] CostsChanged cost %lf seconds, changed_cells.size() %d, "
+                "long_range_changed_cells.size() %d, affected_entries.size() %d",
+                GetTimeInSeconds() - start_time, (int)changed_cells.size(),
+                (int)long_range_changed_cells.size(), (int)affected_entries.size());
 
   if (affected_entries.size() <= 0) return true;
 
   // update preds of changed edges
+  stats_.num_of_affected_states = affected_entries.size();
   if (affected_entries.size() > map_size_ * map_size_ * size_dir_ / 10 || affected_entries.size() > force_scratch_limit_) {
-    need_to_reinitialize_environment_ = true;
+    RequestReinitialization(REPLAN_TOO_MANY_CHANGES);
   }
 
   for (const auto& entry : affected_entries) {
-    if (entry->visited_iteration == environment_iteration_) {
-      RecomputeRHSVal(entry);
-      UpdateSetMembership(entry);
-    }
+    RecomputeRHSVal(entry);
+    UpdateSetMembership(entry);
   }
 
   // reset eps for which we know a path was computed
@@ -733,6 +1053,66 @@ bool SearchBasedGlobalPlanner::CostsChanged(const std::vector<XYCell>& changed_c
   return true;
 }
 
+void SearchBasedGlobalPlanner::ClearInconsist() {
+  // stamps of entries still in the list become stale
+  inconsist_.clear();
+  inconsist_epoch_++;
+}
+
+void SearchBasedGlobalPlanner::SyncWindowCosts() {
+  for (int iy = 0; iy < map_size_; ++iy) {
+    for (int ix = 0; ix < map_size_; ++ix) {
+      window_costs_[iy * map_size_ + ix] = env_->GetCost(ix, iy);
+    }
+  }
+}
+
+void SearchBasedGlobalPlanner::ImportCostmap(int start_cell_x, int start_cell_y, int shift_x, int shift_y,
+                                             std::vector<XYCell>* changed_cells) {
+  int size_x = costmap_->getSizeInCellsX();
+  int size_y = costmap_->getSizeInCellsY();
+  const unsigned char* char_map = costmap_->getCharMap();
+  // cells out of costmap are unknown, window may stick out by less than a tile
+  unsigned char unknown_cost = cost_table_[costmap_2d::NO_INFORMATION];
+  int min_ix = std::min(map_size_, std::max(0, -start_cell_x));
+  int max_ix = std::max(min_ix, std::min(map_size_, size_x - start_cell_x));
+  unsigned char* row = &row_costs_[0];
+
+  for (int iy = 0; iy < map_size_; ++iy) {
+    int my = iy + start_cell_y;
+    if (my < 0 || my >= size_y) {
+      memset(row, unknown_cost, map_size_);
+    } else {
+      const unsigned char* costmap_row = char_map + my * size_x;
+      memset(row, unknown_cost, min_ix);
+      for (int ix = min_ix; ix < max_ix; ++ix) row[ix] = cost_table_[costmap_row[ix + start_cell_x]];
+      memset(row + max_ix, unknown_cost, map_size_ - max_ix);
+    }
+
+    // compare 8 cells at a time, most of them don't change
+    unsigned char* old_row = &window_costs_[iy * map_size_];
+    bool kept_row = iy + shift_y >= 0 && iy + shift_y < map_size_;
+    for (int ix = 0; ix < map_size_; ix += 8) {
+      int end = std::min(ix + 8, map_size_);
+      if (end - ix == 8) {
+        uint64_t new_costs, old_costs;
+        memcpy(&new_costs, row + ix, 8);
+        memcpy(&old_costs, old_row + ix, 8);
+        if (new_costs == old_costs) continue;
+      }
+      for (int k = ix; k < end; ++k) {
+        if (row[k] == old_row[k]) continue;
+        old_row[k] = row[k];
+        env_->UpdateCost(k, iy, row[k]);
+        // cells exposed by moving window are handled with border_entries
+        if (kept_row && k + shift_x >= 0 && k + shift_x < map_size_) {
+          changed_cells->push_back(XYCell(k, iy));
+        }
+      }
+    }
+  }
+}
+
 unsigned char SearchBasedGlobalPlanner::TransformCostmapCost(unsigned char cost) {
   if (cost == costmap_2d::LETHAL_OBSTACLE || cost == costmap_2d::NO_INFORMATION) {
     return lethal_cost_;
@@ -745,19 +1125,13 @@ unsigned char SearchBasedGlobalPlanner::TransformCostmapCost(unsigned char cost)
   }
 }
 
-bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
-                                        geometry_msgs::PoseStamped goal,
-                                        std::vector<geometry_msgs::PoseStamped>& plan,
-                                        fixpattern_path::Path& path, bool broader_start_and_goal, bool extend_path) {
-#ifdef DEBUG
-  ProfilerStart("sbpl.prof");
-#endif
-  if (!initialized_) {
-    GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] SearchBasedGlobalPlanner is not initialized");
-    return false;
-  }
-
-  plan.clear();
+bool SearchBasedGlobalPlanner::PlanPointPath(const geometry_msgs::PoseStamped& start,
+                                             const geometry_msgs::PoseStamped& goal,
+                                             bool broader_start_and_goal, std::vector<XYThetaPoint>* point_path,
+                                             std::vector<IntermPointStruct>* path_info, int* cost) {
+  ResetStatistics();
+  route_.clear();
+  unsigned int env_allocations = env_->GetNumOfAllocations();
 
   broader_start_and_goal_ = broader_start_and_goal;
   ROS_INFO_COND(broader_start_and_goal_, "[SEARCH BASED GLOBAL PLANNER] broader_start_and_goal: true");
@@ -778,29 +1152,29 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
     return false;
   }
 
-  // get lower left point of sbpl map
-  unsigned int start_cell_x = 0;
-  unsigned int start_cell_y = 0;
-  if (cell_x > map_size_ / 2 && cell_x <= costmap_->getSizeInCellsX() - map_size_ / 2) {
-    start_cell_x = cell_x - map_size_ / 2;
-  } else if (cell_x > costmap_->getSizeInCellsX() - map_size_ / 2) {
-    start_cell_x = costmap_->getSizeInCellsX() - map_size_;
-  }
-  if (cell_y > map_size_ / 2 && cell_y <= costmap_->getSizeInCellsY() - map_size_ / 2) {
-    start_cell_y = cell_y - map_size_ / 2;
-  } else if (cell_y > costmap_->getSizeInCellsY() - map_size_ / 2) {
-    start_cell_y = costmap_->getSizeInCellsY() - map_size_;
-  }
+  // window is anchored to world cells, so that lattice states and costs
+  // survive when it moves, costmap cell x is world cell x + origin_cell_x
+  int origin_cell_x = static_cast<int>(floor(costmap_->getOriginX() / resolution_ + 0.5));
+  int origin_cell_y = static_cast<int>(floor(costmap_->getOriginY() / resolution_ + 0.5));
+  int shift_x, shift_y;
+  border_entries_.clear();
+  ShiftWindow(static_cast<int>(cell_x) + origin_cell_x, static_cast<int>(cell_y) + origin_cell_y,
+              &shift_x, &shift_y, &border_entries_);
 
-  double start_x, start_y;
-  costmap_->mapToWorld(start_cell_x, start_cell_y, start_x, start_y);
-  start_x -= resolution_ / 2.0;
-  start_y -= resolution_ / 2.0;
+  // get lower left point of sbpl map
+  int start_cell_x = window_origin_x_ - origin_cell_x;
+  int start_cell_y = window_origin_y_ - origin_cell_y;
+  double start_x = costmap_->getOriginX() + start_cell_x * resolution_;
+  double start_y = costmap_->getOriginY() + start_cell_y * resolution_;
+  window_x_m_ = start_x;
+  window_y_m_ = start_y;
 
   // set start and goal point, we have to set goal first in case computing
   // heuristic values when set start
   EnvironmentEntry3D* last_goal_entry = goal_entry_;
   EnvironmentEntry3D* last_start_entry = start_entry_;
+  // free space heuristic would overestimate for the broader start entries
+  env_->UseFreeSpaceHeuristic(!broader_start_and_goal_);
   goal_entry_ = env_->SetGoal(goal.pose.position.x - start_x,
                              goal.pose.position.y - start_y, theta_goal);
   start_entry_ = env_->SetStart(start.pose.position.x - start_x,
@@ -815,7 +1189,7 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
   if (last_goal_entry != goal_entry_) {
     // if goal changed, we want to ReInitializeSearchEnvironment
     // plz refer to sbpl project
-    need_to_reinitialize_environment_ = true;
+    RequestReinitialization(REPLAN_GOAL_CHANGED);
   }
 
   // we want to enforce reintialization temporarily
@@ -825,35 +1199,435 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
            goal_entry_->x, goal_entry_->y, goal_entry_->theta, start_entry_->x, start_entry_->y, start_entry_->theta);
 
   // update costs that are changed
-  std::vector<XYCell> changed_cells;
+  double before_import = GetTimeInSeconds();
+  changed_cells_.clear();
+  ImportCostmap(start_cell_x, start_cell_y, shift_x, shift_y, &changed_cells_);
+  ReleaseCostmap();
+  long_range_changed_cells_.clear();
+  env_->UpdateLongRangeCells(&long_range_changed_cells_);
+  env_->UpdateClearance();
+  stats_.num_of_changed_cells = changed_cells_.size();
+
+  double before_costs_changed = GetTimeInSeconds();
+  stats_.import_costs_time = before_costs_changed - before_import;
+  if (!changed_cells_.empty() || !long_range_changed_cells_.empty() || !border_entries_.empty())
+    CostsChanged(changed_cells_, long_range_changed_cells_, border_entries_);
+  stats_.costs_changed_time = GetTimeInSeconds() - before_costs_changed;
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] CostsChanged cost %lf seconds", stats_.costs_changed_time);
+
+  // compute plan
+  point_path->clear();
+  path_info->clear();
+  bool found = search(point_path, path_info);
+  stats_.num_of_allocations += env_->GetNumOfAllocations() - env_allocations;
+
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] point_path size = %d; path_info size = %d", (int)point_path->size(), (int)path_info->size());
+  if (!found || point_path->size() == 0)
+    return false;
+
+  WindowToWorld(point_path);
+  if (epsilon_satisfied_ <= 1.0 && route_cache_size_ > 0) {
+    GetRouteFromEntryPath(entry_path_, &route_);
+  }
+  stats_.found = true;
+  stats_.path_cost = env_->GetSuperStart()->rhs;
+  if (cost != NULL) *cost = env_->GetSuperStart()->rhs;
+  return true;
+}
 
-  for (unsigned int ix = 0; ix < map_size_; ++ix) {
-    for (unsigned int iy = 0; iy < map_size_; ++iy) {
-      unsigned char old_cost = env_->GetCost(ix, iy);
-      unsigned char new_cost = TransformCostmapCost(costmap_->getCost(ix + start_cell_x, iy + start_cell_y));
+void SearchBasedGlobalPlanner::RequestReinitialization(ReplanReason reason) {
+  if (!need_to_reinitialize_environment_) reinitialize_reason_ = reason;
+  need_to_reinitialize_environment_ = true;
+}
+
+void SearchBasedGlobalPlanner::PublishStatistics() {
+  static const char* REPLAN_REASON_NAMES[] = {"incremental", "first_plan", "goal_changed",
+                                              "window_jumped", "too_many_changes"};
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] plan %s in %lf seconds, %s, eps %.3f, %u expansions, "
+                "%u heap operations, %u states visited, %u collision checks, %u cache hits of %u lookups",
+                stats_.found ? "found" : "not found", stats_.total_time,
+                stats_.cache_hit ? "cached" : REPLAN_REASON_NAMES[stats_.replan_reason],
+                stats_.epsilon_satisfied, stats_.num_of_expansions, stats_.num_of_heap_operations,
+                stats_.num_of_states_visited, stats_.num_of_collision_checks, stats_.num_of_cache_hits,
+                stats_.num_of_cache_lookups);
+  if (!publish_statistics_ || portfolio_index_ != 0) return;
+
+  // one flat yaml mapping, so that it's easy to read and to parse
+  char buffer[1024];
+  int length = snprintf(buffer, sizeof(buffer),
+      "{found: %d, path_cost: %d, epsilon_satisfied: %.3f, replan_reason: %s, total_time: %.6f, "
+      "import_costs_time: %.6f, costs_changed_time: %.6f, heuristic_time: %.6f, path_extraction_time: %.6f, "
+      "changed_cells: %u, affected_states: %u, expansions: %u, heap_operations: %u, states_visited: %u, "
+      "states_generated: %u, collision_checks: %u, allocations: %u, cache_hit: %d, cache_lookups: %u, cache_hits: %u, rounds: [",
+      stats_.found, stats_.path_cost, stats_.epsilon_satisfied, REPLAN_REASON_NAMES[stats_.replan_reason],
+      stats_.total_time, stats_.import_costs_time, stats_.costs_changed_time, stats_.heuristic_time,
+      stats_.path_extraction_time, stats_.num_of_changed_cells, stats_.num_of_affected_states,
+      stats_.num_of_expansions, stats_.num_of_heap_operations, stats_.num_of_states_visited,
+      stats_.num_of_states_generated, stats_.num_of_collision_checks, stats_.num_of_allocations, stats_.cache_hit,
+      stats_.num_of_cache_lookups, stats_.num_of_cache_hits);
+  std_msgs::String msg;
+  msg.data.assign(buffer, std::min<int>(length, sizeof(buffer) - 1));
+  for (unsigned int i = 0; i < stats_.rounds.size() && i < MAX_PUBLISHED_EPSILON_ROUNDS; ++i) {
+    const EpsilonRoundStatistics& round = stats_.rounds[i];
+    length = snprintf(buffer, sizeof(buffer), "%s{epsilon: %.3f, found: %d, time: %.6f, expansions: %u}",
+                      i > 0 ? ", " : "", round.epsilon, round.found, round.time, round.num_of_expansions);
+    msg.data.append(buffer, std::min<int>(length, sizeof(buffer) - 1));
+  }
+  msg.data += "]}";
+  statistics_pub_.publish(msg);
+}
 
-      if (old_cost == new_cost) continue;
+void SearchBasedGlobalPlanner::ChooseEpsilonSchedule() {
+  eps_ = initial_epsilon_;
+  stop_time_ = allocated_time_;
+  learning_plan_ = false;
+  if (!epsilon_tuner_.IsEnabled()) return;
+
+  int margin = static_cast<int>(EPSILON_TUNING_CLUTTER_MARGIN / resolution_);
+  double clutter = env_->GetCostCellRatio(std::min(start_entry_->x, goal_entry_->x) - margin,
+                                          std::min(start_entry_->y, goal_entry_->y) - margin,
+                                          std::max(start_entry_->x, goal_entry_->x) + margin,
+                                          std::max(start_entry_->y, goal_entry_->y) + margin);
+  double distance = resolution_ * hypot(start_entry_->x - goal_entry_->x, start_entry_->y - goal_entry_->y);
+  learning_plan_ = epsilon_tuner_.ChooseSchedule(distance, clutter, &eps_, &stop_time_);
+}
 
-      env_->UpdateCost(ix, iy, new_cost);
+unsigned int SearchBasedGlobalPlanner::CountBufferGrowth() {
+  unsigned int grown = 0;
+  size_t index = 0;
+  grown += CountGrowth(inconsist_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(open_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(succ_entries_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(succ_costs_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(succ_actions_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(pred_entries_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(pred_costs_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(pred_actions_buf_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(affected_entries_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(border_entries_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(changed_cells_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(long_range_changed_cells_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(entry_path_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(endpoint_entries_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(route_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(affected_stamps_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(window_costs_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(row_costs_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(dropped_entries_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(actions_path_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(sum_distance_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(sum_turning_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(round_end_times_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(round_costs_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(point_path_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(path_info_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(path_points_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(stats_.rounds.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(improved_plan_.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(portfolio_result_.point_path.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(portfolio_result_.path_info.capacity(), &buffer_capacities_, &index);
+  grown += CountGrowth(portfolio_result_.route.capacity(), &buffer_capacities_, &index);
+  return grown;
+}
 
-      XYCell cell(ix, iy);
-      changed_cells.push_back(cell);
+void SearchBasedGlobalPlanner::ResetStatistics() {
+  stats_.num_of_allocations = 0;
+  stats_.found = false;
+  stats_.path_cost = INFINITECOST;
+  stats_.epsilon_satisfied = INFINITECOST;
+  stats_.replan_reason = REPLAN_INCREMENTAL;
+  stats_.import_costs_time = stats_.costs_changed_time = stats_.heuristic_time = stats_.path_extraction_time = 0.0;
+  stats_.rounds.clear();
+  stats_.num_of_changed_cells = stats_.num_of_affected_states = 0;
+  stats_.num_of_expansions = stats_.num_of_heap_operations = 0;
+  stats_.num_of_states_visited = stats_.num_of_states_generated = 0;
+  stats_.num_of_collision_checks = 0;
+  stats_.cache_hit = false;
+}
+
+bool SearchBasedGlobalPlanner::GetWorldState(const geometry_msgs::PoseStamped& pose, XYThetaCell* state) {
+  unsigned int cell_x, cell_y;
+  if (!costmap_->worldToMap(pose.pose.position.x, pose.pose.position.y, cell_x, cell_y)) return false;
+  // same cells as lattice states of window, see PlanPointPath
+  state->x = CONTXY2DISC(pose.pose.position.x - costmap_->getOriginX(), resolution_) +
+             static_cast<int>(floor(costmap_->getOriginX() / resolution_ + 0.5));
+  state->y = CONTXY2DISC(pose.pose.position.y - costmap_->getOriginY(), resolution_) +
+             static_cast<int>(floor(costmap_->getOriginY() / resolution_ + 0.5));
+  state->theta = ContTheta2Disc(2 * atan2(pose.pose.orientation.z, pose.pose.orientation.w), size_dir_);
+  return true;
+}
+
+bool SearchBasedGlobalPlanner::GetRouteFromEntryPath(const std::vector<EnvironmentEntry3D*>& entry_path,
+                                                     std::vector<RouteStep>* route) {
+  route->clear();
+  for (unsigned int i = 0; i + 1 < entry_path.size(); ++i) {
+    const Action* action = env_->GetColdEntry(entry_path[i])->best_action;
+    if (action == NULL) {
+      route->clear();
+      return false;
     }
+    RouteStep step;
+    step.x = entry_path[i]->x + window_origin_x_;
+    step.y = entry_path[i]->y + window_origin_y_;
+    step.theta = entry_path[i]->theta;
+    step.action_index = action->action_index;
+    route->push_back(step);
   }
+  return !route->empty();
+}
 
-  double before_costs_changed = GetTimeInSeconds();
-  if (!changed_cells.empty())
-    CostsChanged(changed_cells);
-  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] CostsChanged cost %lf seconds", GetTimeInSeconds() - before_costs_changed);
+bool SearchBasedGlobalPlanner::IsRouteFree(const std::vector<RouteStep>& route) {
+  // costmap cell x is world cell x - origin_cell_x
+  int origin_cell_x = static_cast<int>(floor(costmap_->getOriginX() / resolution_ + 0.5));
+  int origin_cell_y = static_cast<int>(floor(costmap_->getOriginY() / resolution_ + 0.5));
+  int size_x = costmap_->getSizeInCellsX();
+  int size_y = costmap_->getSizeInCellsY();
+  for (const auto& step : route) {
+    const Action* action = env_->GetAction(step.theta, step.action_index);
+    int x = step.x - origin_cell_x;
+    int y = step.y - origin_cell_y;
+    // same test as Environment::ComputeActionCost, on costmap_ instead of window
+    unsigned char max_cost = 0;
+    for (const auto& cell : action->interm_cells_3d) {
+      int cx = x + cell.x, cy = y + cell.y;
+      if (cx < 0 || cy < 0 || cx >= size_x || cy >= size_y) return false;
+      max_cost = std::max(max_cost, cost_table_[costmap_->getCost(cx, cy)]);
+    }
+    if (max_cost >= inscribed_inflated_cost_) return false;
+    if (max_cost < cost_possibly_circumscribed_thresh_) continue;
+    for (const auto& cell : action->circle_center_cells) {
+      int cx = x + cell.x, cy = y + cell.y;
+      if (cx < 0 || cy < 0 || cx >= size_x || cy >= size_y) return false;
+      if (cost_table_[costmap_->getCost(cx, cy)] >= inscribed_inflated_cost_) return false;
+    }
+  }
+  return true;
+}
 
-  // compute plan
-  std::vector<XYThetaPoint> point_path;
-  std::vector<IntermPointStruct> path_info;
-  search(&point_path, &path_info);
+bool SearchBasedGlobalPlanner::LookUpRouteCache(const XYThetaCell& start, const XYThetaCell& goal,
+                                                bool broader_start_and_goal, std::vector<XYThetaPoint>* point_path,
+                                                std::vector<IntermPointStruct>* path_info) {
+  stats_.num_of_cache_lookups++;
+  const std::string map_id = costmap_ros_->getGlobalFrameID();
+  std::list<CachedRoute>::iterator it = route_cache_.begin();
+  for (; it != route_cache_.end(); ++it) {
+    if (it->start == start && it->goal == goal &&
+        it->broader_start_and_goal == broader_start_and_goal && it->map_id == map_id) break;
+  }
+  if (it == route_cache_.end()) return false;
 
-  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] point_path size = %d; path_info size = %d", (int)point_path.size(), (int)path_info.size());
-  if (point_path.size() == 0)
+  if (!IsRouteFree(it->steps)) {
+    GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] cached route is blocked, search again");
+    route_cache_.erase(it);
     return false;
+  }
+
+  // most recently used goes first
+  route_cache_.splice(route_cache_.begin(), route_cache_, it);
+  ResetStatistics();
+  stats_.cache_hit = true;
+  stats_.found = true;
+  stats_.path_cost = it->cost;
+  stats_.epsilon_satisfied = 1.0;
+  stats_.num_of_cache_hits++;
+  *point_path = it->point_path;
+  *path_info = it->path_info;
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] take cached route, %u hits of %u lookups",
+                stats_.num_of_cache_hits, stats_.num_of_cache_lookups);
+  return true;
+}
+
+void SearchBasedGlobalPlanner::InsertToRouteCache(const XYThetaCell& start, const XYThetaCell& goal,
+                                                  bool broader_start_and_goal,
+                                                  const std::vector<XYThetaPoint>& point_path,
+                                                  const std::vector<IntermPointStruct>& path_info) {
+  // reuse the least recently used one when full
+  if (route_cache_.size() >= static_cast<size_t>(route_cache_size_)) {
+    route_cache_.splice(route_cache_.begin(), route_cache_, --route_cache_.end());
+  } else {
+    route_cache_.push_front(CachedRoute());
+  }
+  CachedRoute& route = route_cache_.front();
+  route.start = start;
+  route.goal = goal;
+  route.broader_start_and_goal = broader_start_and_goal;
+  route.map_id = costmap_ros_->getGlobalFrameID();
+  route.cost = stats_.path_cost;
+  route.steps = route_;
+  route.point_path = point_path;
+  route.path_info = path_info;
+}
+
+void SearchBasedGlobalPlanner::WindowToWorld(std::vector<XYThetaPoint>* point_path) {
+  // points are relative to lower left of window
+  for (unsigned int i = 0; i < point_path->size(); ++i) {
+    point_path->at(i).x += window_x_m_;
+    point_path->at(i).y += window_y_m_;
+  }
+}
+
+void SearchBasedGlobalPlanner::ImproveInBackground(geometry_msgs::PoseStamped start, geometry_msgs::PoseStamped goal) {
+  // same time limit as the search which found the first path
+  int last_cost = env_->GetSuperStart()->rhs;
+  // makePlan is done with point_path_ and path_info_ until it cancels this
+  while (epsilon_satisfied_ > 1.0 && GetTimeInSeconds() - start_time_ < GetTimeLimit() && !*stop_flag_) {
+    bool found = ImprovePath();
+    if (env_->GetSuperStart()->rhs == INFINITECOST) break;
+    if (!found || env_->GetSuperStart()->rhs >= last_cost) continue;
+
+    entry_path_.clear();
+    GetEntryPath(&entry_path_);
+    point_path_.clear();
+    path_info_.clear();
+    GetPointPathFromEntryPath(entry_path_, &point_path_, &path_info_);
+    if (point_path_.size() == 0) continue;
+    WindowToWorld(&point_path_);
+    last_cost = env_->GetSuperStart()->rhs;
+    OfferPlan(start, goal, point_path_, path_info_, last_cost);
+  }
+  // nothing could be cheaper than an optimal path over all primitives
+  if (full_primitive_set_ && epsilon_satisfied_ <= 1.0) *stop_flag_ = true;
+}
+
+void SearchBasedGlobalPlanner::OfferPlan(const geometry_msgs::PoseStamped& start,
+                                         const geometry_msgs::PoseStamped& goal,
+                                         const std::vector<XYThetaPoint>& point_path,
+                                         const std::vector<IntermPointStruct>& path_info, int cost) {
+  BuildPlan(start, goal, point_path, path_info, improved_plan_, improved_path_);
+  unsigned int version = portfolio_owner_->StorePlan(improved_plan_, improved_path_, cost);
+  if (version == 0) return;
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] improved path of cost %d for eps=%.3f by instance %d, version %u",
+                cost, epsilon_satisfied_, portfolio_index_, version);
+}
+
+void SearchBasedGlobalPlanner::CancelImprovement() {
+  *stop_flag_ = true;
+  if (improve_thread_.joinable()) improve_thread_.join();
+  for (unsigned int i = 0; i < portfolio_.size(); ++i) {
+    if (portfolio_[i]->improve_thread_.joinable()) portfolio_[i]->improve_thread_.join();
+  }
+  *stop_flag_ = false;
+
+  boost::mutex::scoped_lock lock(plan_slot_mutex_);
+  slot_cost_ = INFINITECOST;
+}
+
+unsigned int SearchBasedGlobalPlanner::StorePlan(const std::vector<geometry_msgs::PoseStamped>& plan,
+                                                 const fixpattern_path::Path& path, int cost) {
+  boost::mutex::scoped_lock lock(plan_slot_mutex_);
+  // instances of portfolio improve concurrently, only a cheaper path is news
+  if (cost >= slot_cost_) return 0;
+  slot_cost_ = cost;
+  slot_plan_ = plan;
+  slot_path_ = path;
+  // under the lock, so that the topic also ends with the cheapest path
+  PublishPlan(plan);
+  return ++plan_version_;
+}
+
+bool SearchBasedGlobalPlanner::GetImprovedPlan(unsigned int* version,
+                                               std::vector<geometry_msgs::PoseStamped>* plan,
+                                               fixpattern_path::Path* path) {
+  if (plan_version_ <= *version) return false;
+  // don't wait for the improving thread, next poll will take it
+  boost::mutex::scoped_try_lock lock(plan_slot_mutex_);
+  if (!lock.owns_lock()) return false;
+  *plan = slot_plan_;
+  *path = slot_path_;
+  *version = plan_version_;
+  return true;
+}
+
+void SearchBasedGlobalPlanner::RunPortfolioMember(geometry_msgs::PoseStamped start,
+                                                  geometry_msgs::PoseStamped goal,
+                                                  bool broader_start_and_goal) {
+  int cost = INFINITECOST;
+  bool found = PlanPointPath(start, goal, broader_start_and_goal, &point_path_, &path_info_, &cost);
+  ReleaseCostmap();
+  // a path found after the first one of the portfolio is an improvement
+  bool first = portfolio_owner_->TakeFirstPath(found, cost, portfolio_index_, point_path_, path_info_, route_);
+  if (!found) return;
+  if (!first) OfferPlan(start, goal, point_path_, path_info_, cost);
+  ImproveInBackground(start, goal);
+}
+
+bool SearchBasedGlobalPlanner::TakeFirstPath(bool found, int cost, int instance,
+                                             const std::vector<XYThetaPoint>& point_path,
+                                             const std::vector<IntermPointStruct>& path_info,
+                                             const std::vector<RouteStep>& route) {
+  boost::mutex::scoped_lock lock(portfolio_mutex_);
+  portfolio_searching_--;
+  bool first = found && !portfolio_result_.found;
+  if (first) {
+    portfolio_result_.found = true;
+    portfolio_result_.cost = cost;
+    portfolio_result_.instance = instance;
+    portfolio_result_.point_path = point_path;
+    portfolio_result_.path_info = path_info;
+    portfolio_result_.route = route;
+    portfolio_found_ = true;
+  }
+  portfolio_cond_.notify_all();
+  return first;
+}
+
+void SearchBasedGlobalPlanner::ReleaseCostmap() {
+  if (!reading_costmap_) return;
+  reading_costmap_ = false;
+  boost::mutex::scoped_lock lock(portfolio_owner_->portfolio_mutex_);
+  portfolio_owner_->portfolio_reading_costmap_--;
+  portfolio_owner_->portfolio_cond_.notify_all();
+}
+
+bool SearchBasedGlobalPlanner::PlanWithPortfolio(const geometry_msgs::PoseStamped& start,
+                                                 const geometry_msgs::PoseStamped& goal,
+                                                 bool broader_start_and_goal, std::vector<XYThetaPoint>* point_path,
+                                                 std::vector<IntermPointStruct>* path_info) {
+  // every instance searches within its own allocated_time_, members in their
+  // improve_thread_ and this one in the calling thread. The first path found
+  // is returned as soon as members are done with costmap_, the others come
+  // through the plan slot
+  portfolio_result_.found = false;
+  portfolio_found_ = false;
+  portfolio_searching_ = portfolio_.size() + 1;
+  portfolio_reading_costmap_ = portfolio_.size();
+  for (unsigned int i = 0; i < portfolio_.size(); ++i) {
+    portfolio_[i]->reading_costmap_ = true;
+    portfolio_[i]->improve_thread_ = boost::thread(boost::bind(&SearchBasedGlobalPlanner::RunPortfolioMember,
+                                                               portfolio_[i], start, goal, broader_start_and_goal));
+  }
+  int cost = INFINITECOST;
+  yield_to_portfolio_ = true;
+  bool found = PlanPointPath(start, goal, broader_start_and_goal, point_path, path_info, &cost);
+  yield_to_portfolio_ = false;
+  bool first = TakeFirstPath(found, cost, portfolio_index_, *point_path, *path_info, route_);
+  if (found && !first) OfferPlan(start, goal, *point_path, *path_info, cost);
+
+  boost::mutex::scoped_lock lock(portfolio_mutex_);
+  while ((!portfolio_result_.found && portfolio_searching_ > 0) || portfolio_reading_costmap_ > 0) {
+    portfolio_cond_.wait(lock);
+  }
+  if (!portfolio_result_.found) return false;
+
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] take path of cost %d of portfolio instance %d",
+                portfolio_result_.cost, portfolio_result_.instance);
+  if (!first) {
+    *point_path = portfolio_result_.point_path;
+    *path_info = portfolio_result_.path_info;
+    route_ = portfolio_result_.route;
+  }
+  stats_.found = true;
+  stats_.path_cost = portfolio_result_.cost;
+  return true;
+}
+
+void SearchBasedGlobalPlanner::BuildPlan(const geometry_msgs::PoseStamped& start,
+                                         const geometry_msgs::PoseStamped& goal,
+                                         const std::vector<XYThetaPoint>& point_path,
+                                         const std::vector<IntermPointStruct>& path_info,
+                                         std::vector<geometry_msgs::PoseStamped>& plan,
+                                         fixpattern_path::Path& path) {  // NOLINT
+  plan.clear();
 
   // fill plan
   ros::Time plan_time = ros::Time::now();
@@ -862,8 +1636,8 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
     pose.header.stamp = plan_time;
     pose.header.frame_id = costmap_ros_->getGlobalFrameID();
 
-    pose.pose.position.x = point_path[i].x + start_x;
-    pose.pose.position.y = point_path[i].y + start_y;
+    pose.pose.position.x = point_path[i].x;
+    pose.pose.position.y = point_path[i].y;
     pose.pose.position.z = start.pose.position.z;
 
     tf::Quaternion temp;
@@ -877,11 +1651,9 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
   }
   plan.push_back(goal);
 
-  // publish the plan
-  PublishPlan(plan);
-
   // assign to fixpattern_path::Path
-  std::vector<fixpattern_path::PathPoint> tmp_path;
+  std::vector<fixpattern_path::PathPoint>& tmp_path = path_points_;
+  tmp_path.clear();
   for (unsigned int i = 0; i < plan.size() - 1; ++i) {
     //GAUSSIAN_INFO("[SBPL] path_info[%d]", i);
     if (path_info[i].is_corner) {
@@ -983,6 +1755,63 @@ bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
     path.set_sbpl_path(tmp_path);
   }
 */
+}
+
+bool SearchBasedGlobalPlanner::makePlan(geometry_msgs::PoseStamped start,
+                                        geometry_msgs::PoseStamped goal,
+                                        std::vector<geometry_msgs::PoseStamped>& plan,
+                                        fixpattern_path::Path& path, bool broader_start_and_goal, bool extend_path) {
+#ifdef DEBUG
+  ProfilerStart("sbpl.prof");
+#endif
+  if (!initialized_) {
+    GAUSSIAN_ERROR("[SEARCH BASED GLOBAL PLANNER] SearchBasedGlobalPlanner is not initialized");
+    return false;
+  }
+
+  // start or goal may have changed, improving the last path is pointless
+  CancelImprovement();
+  unsigned int last_version = plan_version_;
+  plan.clear();
+
+  // compute plan, search only if the route isn't cached or is blocked now
+  double start_time = GetTimeInSeconds();
+  std::vector<XYThetaPoint>& point_path = point_path_;
+  std::vector<IntermPointStruct>& path_info = path_info_;
+  point_path.clear();
+  path_info.clear();
+  XYThetaCell start_state, goal_state;
+  bool cacheable = route_cache_size_ > 0 && GetWorldState(start, &start_state) && GetWorldState(goal, &goal_state);
+  bool found = cacheable &&
+      LookUpRouteCache(start_state, goal_state, broader_start_and_goal, &point_path, &path_info);
+  if (!found) {
+    found = portfolio_.empty() ?
+        PlanPointPath(start, goal, broader_start_and_goal, &point_path, &path_info, NULL) :
+        PlanWithPortfolio(start, goal, broader_start_and_goal, &point_path, &path_info);
+    if (found && cacheable && !route_.empty()) {
+      InsertToRouteCache(start_state, goal_state, broader_start_and_goal, point_path, path_info);
+    }
+  }
+  stats_.total_time = GetTimeInSeconds() - start_time;
+  if (found) BuildPlan(start, goal, point_path, path_info, plan, path);
+  stats_.num_of_allocations += CountBufferGrowth();
+  GAUSSIAN_INFO("[SEARCH BASED GLOBAL PLANNER] allocations of search buffers: %u", stats_.num_of_allocations);
+  PublishStatistics();
+  if (!found)
+    return false;
+
+  // keep improving it in background, improved ones go to the plan slot,
+  // which publishes them
+  if (!background_improvement_) {
+    PublishPlan(plan);
+  } else {
+    last_plan_version_ = StorePlan(plan, path, stats_.path_cost);
+    // a member of portfolio stored and published a cheaper path already
+    if (last_plan_version_ == 0) last_plan_version_ = last_version;
+    if (!stats_.cache_hit && epsilon_satisfied_ > 1.0) {
+      improve_thread_ = boost::thread(boost::bind(&SearchBasedGlobalPlanner::ImproveInBackground, this, start, goal));
+    }
+  }
 
 #ifdef DEBUG
   ProfilerStop();